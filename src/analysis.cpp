@@ -0,0 +1,617 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "analysis.h"
+#include "hash.h"
+#include "match.h"
+#include "output.h"
+#include "packedpos.h"
+#include "search.h"
+#include "uci.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+ * @brief A position from the input file together with the best result found
+ * for it so far.
+ */
+struct AnalysisPosition {
+    unsigned int lineNumber;
+    Board board;
+    std::string id;
+    SearchResult result;
+    // Totals over all searches of this position
+    uint64_t nodes;
+    uint64_t time;
+    int searches;
+    // Node limit for the next search when scheduling a budget
+    int nodeLimit;
+    // The worker that searched the position first, or -1
+    int worker;
+
+    AnalysisPosition() : lineNumber(0), nodes(0), time(0), searches(0), nodeLimit(0), worker(-1) {}
+};
+
+/**
+ * @brief Work shared by all analysis workers during one pass. Positions are
+ * handed out one at a time through an atomic index, so fast and slow
+ * positions balance out across workers without any locking. When pinned,
+ * each worker instead searches only the positions it searched first, whose
+ * entries are in its own hash table.
+ */
+struct AnalysisJob {
+    const AnalysisOptions *options;
+    std::vector<AnalysisPosition> positions;
+    // Indices of the positions to search in this pass
+    std::vector<unsigned int> queue;
+    std::atomic<unsigned int> nextTask;
+    // Print results as they finish, rather than all at the end
+    bool printResults;
+    bool pinned;
+    std::atomic<uint64_t> nodes;
+    // The table shared by all workers, if any, which is aged once per pass
+    Hash *sharedTable;
+
+    AnalysisJob() : options(nullptr), nextTask(0), printResults(true), pinned(false), nodes(0),
+        sharedTable(nullptr) {}
+};
+
+/**
+ * @brief The root moves of one position and their child positions, which are
+ * handed out to the workers one at a time.
+ */
+struct RootMoveJob {
+    const AnalysisOptions *options;
+    MoveList moves;
+    std::vector<Board> children;
+    std::vector<TwoFoldStack> histories;
+    std::vector<SearchResult> results;
+    std::atomic<unsigned int> nextMove;
+    std::atomic<uint64_t> nodes;
+
+    RootMoveJob() : options(nullptr), nextMove(0), nodes(0) {}
+};
+
+static bool readPositions(const std::string &fileName, std::vector<AnalysisPosition> &positions,
+    uint64_t &errors);
+static void runPass(AnalysisJob &job, std::vector<Search *> &searches);
+static void analysisWorker(AnalysisJob *job, Search *search, int worker);
+static void scheduleBudget(AnalysisJob &job, std::vector<Search *> &searches);
+static int getInstability(const SearchResult &result);
+static void printResult(const AnalysisPosition &position);
+static void rootMoveWorker(RootMoveJob *job, Search *search);
+static void printRootMoves(const AnalysisPosition &position, RootMoveJob &job, bool jsonOutput);
+static int getRootMoveScore(const SearchResult &childResult);
+
+
+// Parses the arguments following "analyze" or "annotate". Returns false after
+// printing a usage message if they do not make sense.
+bool parseAnalysisOptions(int argc, char **argv, AnalysisOptions &options) {
+    if (argc < 1) {
+        cerr << "Usage: laser analyze|annotate <file> [depth <n> | nodes <n> | movetime <ms>] "
+             << "[budget <nodes> [rounds <n>]] [workers <n>] [threads <n>] [hash <MB>] [shared] [json]" << endl;
+        return false;
+    }
+    options.inputFile = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "shared") == 0) {
+            options.sharedHash = true;
+            continue;
+        }
+        if (strcmp(argv[i], "json") == 0) {
+            options.jsonOutput = true;
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (i + 1 >= argc || !parseNumber(argv[i+1], value)) {
+            cerr << "Invalid analysis option: " << argv[i] << endl;
+            return false;
+        }
+        const char *name = argv[i];
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        i++;
+
+        if (strcmp(name, "depth") == 0) {
+            options.limit.searchMode = DEPTH;
+            options.limit.allotment = std::min(MAX_DEPTH, intValue);
+        }
+        else if (strcmp(name, "nodes") == 0) {
+            options.limit.searchMode = NODES;
+            options.limit.allotment = intValue;
+        }
+        else if (strcmp(name, "movetime") == 0) {
+            options.limit.searchMode = MOVETIME;
+            options.limit.allotment = intValue;
+        }
+        else if (strcmp(name, "budget") == 0)
+            options.nodeBudget = value;
+        else if (strcmp(name, "rounds") == 0)
+            options.rounds = intValue;
+        else if (strcmp(name, "workers") == 0)
+            options.workers = std::max(1, intValue);
+        else if (strcmp(name, "threads") == 0)
+            options.threadsPerWorker = std::max(MIN_THREADS, std::min(MAX_THREADS, intValue));
+        else if (strcmp(name, "hash") == 0)
+            options.hashMB = std::max(MIN_HASH_SIZE, std::min(MAX_HASH_SIZE, value));
+        else {
+            cerr << "Invalid analysis option: " << name << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Analyzes every FEN or EPD line of the input file and prints one line per
+ * position:
+ *   position <n> [id "<id>"] bestmove <move> score <cp x|mate y> depth <d>
+ *       nodes <n> time <ms> [searches <k>] pv <moves>
+ * With a fixed limit, results are printed in completion order as soon as they
+ * are finished, so n gives the line number in the file. With a node budget
+ * they are printed in file order after the last round. A summary with the
+ * throughput in positions per hour goes to stderr.
+ */
+void runAnalysis(const AnalysisOptions &options) {
+    AnalysisJob job;
+    job.options = &options;
+
+    uint64_t errors = 0;
+    if (!readPositions(options.inputFile, job.positions, errors))
+        return;
+
+    Hash *sharedTable = nullptr;
+    if (options.sharedHash)
+        sharedTable = new Hash(options.hashMB);
+    job.sharedTable = sharedTable;
+
+    // Each worker keeps its search, and so its own hash table if it has one,
+    // for the whole run
+    int workers = std::max(1, std::min(options.workers, (int) job.positions.size()));
+    std::vector<Search *> searches;
+    for (int i = 0; i < workers; i++) {
+        Search *search = new Search(sharedTable);
+        search->setSilent(true);
+        search->setNumThreads(options.threadsPerWorker);
+        if (sharedTable == nullptr)
+            search->setHashSize(options.hashMB);
+        searches.push_back(search);
+    }
+
+    auto startTime = ChessClock::now();
+
+    if (options.nodeBudget)
+        scheduleBudget(job, searches);
+    else {
+        for (unsigned int i = 0; i < job.positions.size(); i++)
+            job.queue.push_back(i);
+        runPass(job, searches);
+    }
+
+    uint64_t time = std::max((uint64_t) 1, getTimeElapsed(startTime));
+
+    for (unsigned int i = 0; i < searches.size(); i++)
+        delete searches[i];
+    delete sharedTable;
+
+    cerr << "Positions : " << job.positions.size() << endl;
+    cerr << "Errors    : " << errors << endl;
+    cerr << "Time      : " << time << " ms" << endl;
+    cerr << "Nodes     : " << job.nodes << endl;
+    cerr << "NPS       : " << 1000 * job.nodes / time << endl;
+    cerr << "Pos/hour  : " << 3600 * 1000 * job.positions.size() / time << endl;
+}
+
+/*
+ * Scores every legal move of each position in the input file, for when the
+ * scores of the alternatives matter as much as the best move. Instead of a
+ * MultiPV search, which searches the lines one after another, each root move
+ * is played and the resulting position is searched by itself. Workers take
+ * moves in parallel and share one transposition table, and each search uses
+ * aspiration windows around its own previous iteration, so full windows are
+ * only searched when a score moves. A depth limit d searches each child to
+ * depth d-1. One line per position lists all moves from best to worst:
+ *   position <n> [id "<id>"] depth <d> nodes <n> time <ms> moves
+ *       <move> <cp x|mate y> <move> <cp x|mate y> ...
+ * or, with "json", an object with the score and PV of every move.
+ */
+void runRootMoveScoring(const AnalysisOptions &options) {
+    std::vector<AnalysisPosition> positions;
+    uint64_t errors = 0;
+    if (!readPositions(options.inputFile, positions, errors))
+        return;
+
+    Hash sharedTable(options.hashMB);
+    std::vector<Search *> searches;
+    for (int i = 0; i < options.workers; i++) {
+        Search *search = new Search(&sharedTable);
+        search->setSilent(true);
+        search->setNumThreads(options.threadsPerWorker);
+        searches.push_back(search);
+    }
+
+    auto startTime = ChessClock::now();
+    uint64_t totalNodes = 0;
+
+    for (unsigned int p = 0; p < positions.size(); p++) {
+        const Board &board = positions[p].board;
+        const int color = board.getPlayerToMove();
+
+        RootMoveJob job;
+        job.options = &options;
+        job.moves = board.getAllLegalMoves(color);
+        for (unsigned int i = 0; i < job.moves.size(); i++) {
+            Move m = job.moves.get(i);
+            TwoFoldStack history;
+            pushHistory(history, board, m);
+            history.setRootEnd();
+
+            Board child = board.staticCopy();
+            child.doMove(m, color);
+            job.children.push_back(child);
+            job.histories.push_back(history);
+        }
+        job.results.resize(job.moves.size());
+        sharedTable.incrementAge();
+
+        auto positionStart = ChessClock::now();
+        std::vector<std::thread> workerThreads;
+        for (unsigned int i = 0; i < searches.size() && i < job.moves.size(); i++)
+            workerThreads.push_back(std::thread(rootMoveWorker, &job, searches[i]));
+        for (unsigned int i = 0; i < workerThreads.size(); i++)
+            workerThreads[i].join();
+
+        positions[p].nodes = job.nodes;
+        positions[p].time = getTimeElapsed(positionStart);
+        totalNodes += job.nodes;
+        printRootMoves(positions[p], job, options.jsonOutput);
+    }
+
+    uint64_t time = std::max((uint64_t) 1, getTimeElapsed(startTime));
+    for (unsigned int i = 0; i < searches.size(); i++)
+        delete searches[i];
+
+    cerr << "Positions : " << positions.size() << endl;
+    cerr << "Errors    : " << errors << endl;
+    cerr << "Time      : " << time << " ms" << endl;
+    cerr << "Nodes     : " << totalNodes << endl;
+    cerr << "NPS       : " << 1000 * totalNodes / time << endl;
+    cerr << "Pos/hour  : " << 3600 * 1000 * positions.size() / time << endl;
+}
+
+// Returns the operand of the first EPD operation with the given opcode, e.g.
+// "bm" or "id", or an empty view if there is none. Quotes are stripped.
+StringView findEPDOperation(StringView operations, const char *opcode) {
+    for (StringView operation = nextToken(operations, ';'); !operation.empty();
+                    operation = nextToken(operations, ';')) {
+        if (!(nextToken(operation) == opcode))
+            continue;
+
+        while (!operation.empty() && (*operation.begin == ' ' || *operation.begin == '"'))
+            operation.begin++;
+        while (!operation.empty() && (operation.end[-1] == ' ' || operation.end[-1] == '"'))
+            operation.end--;
+        return operation;
+    }
+    return StringView();
+}
+
+
+// Parses a nonnegative decimal command line argument
+bool parseNumber(const char *value, uint64_t &result) {
+    char *end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (end == value || *end != '\0' || *value == '-')
+        return false;
+    result = (uint64_t) parsed;
+    return true;
+}
+
+// Reads the FEN or EPD lines of a file, skipping blank lines and comments and
+// reporting lines that are not valid positions. Packed files are mapped and
+// unpacked directly, with the position's index as its line number.
+static bool readPositions(const std::string &fileName, std::vector<AnalysisPosition> &positions,
+        uint64_t &errors) {
+    if (isPackedPositionFile(fileName)) {
+        PackedPositionFile packed;
+        if (!packed.open(fileName))
+            return false;
+        positions.resize(packed.size());
+        for (uint64_t i = 0; i < packed.size(); i++) {
+            positions[i].board = unpackPosition(packed[i]);
+            positions[i].lineNumber = (unsigned int) (i + 1);
+        }
+        return true;
+    }
+
+    std::ifstream file(fileName);
+    if (!file) {
+        cerr << "Could not open " << fileName << endl;
+        return false;
+    }
+
+    std::string line;
+    for (unsigned int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        StringView text(line);
+        StringView first = text;
+        first = nextToken(first);
+        if (first.empty() || first[0] == '#')
+            continue;
+
+        AnalysisPosition position;
+        StringView operations;
+        if (!parseFEN(text, position.board, &operations)) {
+            errors++;
+            OutputLine() << "position " << lineNumber << " error invalid position";
+            continue;
+        }
+        position.lineNumber = lineNumber;
+        position.id = findEPDOperation(operations, "id").toString();
+        positions.push_back(position);
+    }
+    return true;
+}
+
+// Reads the positions of a FEN/EPD or packed file, for tools that need only
+// the boards
+bool readPositionFile(const std::string &fileName, std::vector<Board> &boards, uint64_t &errors) {
+    std::vector<AnalysisPosition> positions;
+    if (!readPositions(fileName, positions, errors))
+        return false;
+    for (unsigned int i = 0; i < positions.size(); i++)
+        boards.push_back(positions[i].board);
+    return true;
+}
+
+// Searches every position in the job's queue with one thread per worker
+static void runPass(AnalysisJob &job, std::vector<Search *> &searches) {
+    job.nextTask = 0;
+    if (job.sharedTable != nullptr)
+        job.sharedTable->incrementAge();
+    std::vector<std::thread> workerThreads;
+    for (unsigned int i = 0; i < searches.size(); i++)
+        workerThreads.push_back(std::thread(analysisWorker, &job, searches[i], (int) i));
+    for (unsigned int i = 0; i < workerThreads.size(); i++)
+        workerThreads[i].join();
+}
+
+static void analysisWorker(AnalysisJob *job, Search *search, int worker) {
+    MoveList movesToSearch;
+    unsigned int nextPinned = 0;
+
+    while (true) {
+        unsigned int i;
+        if (job->pinned) {
+            while (nextPinned < job->queue.size() && job->positions[job->queue[nextPinned]].worker != worker)
+                nextPinned++;
+            i = nextPinned++;
+        }
+        else
+            i = job->nextTask++;
+        if (i >= job->queue.size())
+            break;
+
+        AnalysisPosition &position = job->positions[job->queue[i]];
+        if (position.worker == -1)
+            position.worker = worker;
+        TimeManagement limit = job->options->limit;
+        if (position.nodeLimit) {
+            limit.searchMode = NODES;
+            limit.allotment = position.nodeLimit;
+        }
+
+        TwoFoldStack *twoFoldPositions = search->getTwoFoldStackPointer();
+        twoFoldPositions->clear();
+        twoFoldPositions->setRootEnd();
+
+        // A position searched before continues from its last result
+        if (position.searches > 0)
+            search->resumeSearch(&position.board, position.result);
+
+        search->isStop = false;
+        search->stopSignal = false;
+        search->getBestMoveThreader(&position.board, &limit, &movesToSearch);
+        search->isStop = true;
+        search->stopSignal = true;
+
+        const SearchResult &result = search->getResult();
+        job->nodes += result.nodes;
+        position.nodes += result.nodes;
+        position.time += result.time;
+        position.searches++;
+        // A later search only replaces the result if it got at least as deep
+        if (position.searches == 1 || result.depth >= position.result.depth)
+            position.result = result;
+
+        if (job->printResults)
+            printResult(position);
+    }
+}
+
+/*
+ * Spends a total node budget where it is needed most. A first pass gives every
+ * position an equal share of SHALLOW_PASS_SHARE of the budget. Each following
+ * round splits an equal part of what is left among the positions whose last
+ * search had not settled, in proportion to how unstable its best move and
+ * score were across iterations. Positions that settle drop out, so easy
+ * positions cost little and critical ones get searched deeper.
+ * A position searched again continues from its last result, on the worker
+ * that searched it before unless the workers share a hash table.
+ */
+static void scheduleBudget(AnalysisJob &job, std::vector<Search *> &searches) {
+    const AnalysisOptions &options = *job.options;
+    job.printResults = false;
+    if (job.positions.empty())
+        return;
+
+    uint64_t shallowNodes = (uint64_t) (options.nodeBudget * SHALLOW_PASS_SHARE) / job.positions.size();
+    for (unsigned int i = 0; i < job.positions.size(); i++) {
+        job.positions[i].nodeLimit = (int) std::max((uint64_t) MIN_SCHEDULED_NODES,
+            std::min(shallowNodes, (uint64_t) 0x7FFFFFFF));
+        job.queue.push_back(i);
+    }
+    runPass(job, searches);
+    job.pinned = (job.sharedTable == nullptr);
+
+    for (int round = 1; round <= options.rounds; round++) {
+        if (job.nodes >= options.nodeBudget)
+            break;
+        uint64_t roundBudget = (options.nodeBudget - job.nodes) / (options.rounds - round + 1);
+
+        job.queue.clear();
+        uint64_t totalWeight = 0;
+        for (unsigned int i = 0; i < job.positions.size(); i++) {
+            int weight = getInstability(job.positions[i].result);
+            if (weight) {
+                job.queue.push_back(i);
+                totalWeight += weight;
+            }
+        }
+        if (job.queue.empty())
+            break;
+
+        for (unsigned int i = 0; i < job.queue.size(); i++) {
+            AnalysisPosition &position = job.positions[job.queue[i]];
+            uint64_t share = roundBudget * getInstability(position.result) / totalWeight;
+            position.nodeLimit = (int) std::max((uint64_t) MIN_SCHEDULED_NODES,
+                std::min(share, (uint64_t) 0x7FFFFFFF));
+        }
+
+        cerr << "Round " << round << ": " << job.queue.size() << " unsettled positions, "
+             << roundBudget << " nodes" << endl;
+        runPass(job, searches);
+    }
+
+    for (unsigned int i = 0; i < job.positions.size(); i++)
+        printResult(job.positions[i]);
+}
+
+// Returns 0 if the search settled on its best move and score, and otherwise a
+// weight that grows with the number of best move changes and the last score
+// swing.
+static int getInstability(const SearchResult &result) {
+    if (result.bestMove == NULL_MOVE || abs(result.score) >= MAX_PLY_MATE_SCORE)
+        return 0;
+    if (result.depth - result.lastChangeDepth >= STABLE_ITERATIONS
+     && result.scoreChange < STABLE_SCORE_CHANGE)
+        return 0;
+    return 1 + result.bestMoveChanges + std::min(result.scoreChange, 400) / STABLE_SCORE_CHANGE;
+}
+
+static void printResult(const AnalysisPosition &position) {
+    const SearchResult &result = position.result;
+    OutputLine out;
+    out << "position " << position.lineNumber;
+    if (!position.id.empty())
+        out << " id \"" << position.id << "\"";
+    if (result.bestMove == NULL_MOVE) {
+        out << " bestmove none score " << scoreToString(result.score);
+        return;
+    }
+    out << " bestmove " << moveToString(result.bestMove)
+        << " score " << scoreToString(result.score)
+        << " depth " << result.depth
+        << " nodes " << position.nodes
+        << " time " << position.time;
+    if (position.searches > 1)
+        out << " searches " << position.searches;
+    out << " pv " << retrievePV(&result.pv);
+}
+
+static void rootMoveWorker(RootMoveJob *job, Search *search) {
+    MoveList movesToSearch;
+    // Children are searched one ply shallower than the root
+    TimeManagement limit = job->options->limit;
+    if (limit.searchMode == DEPTH)
+        limit.allotment = std::max(1, limit.allotment - 1);
+
+    for (unsigned int i = job->nextMove++; i < job->children.size(); i = job->nextMove++) {
+        *search->getTwoFoldStackPointer() = job->histories[i];
+
+        search->isStop = false;
+        search->stopSignal = false;
+        search->getBestMoveThreader(&job->children[i], &limit, &movesToSearch);
+        search->isStop = true;
+        search->stopSignal = true;
+
+        job->results[i] = search->getResult();
+        job->nodes += job->results[i].nodes;
+    }
+}
+
+static void printRootMoves(const AnalysisPosition &position, RootMoveJob &job, bool jsonOutput) {
+    // Sort the moves from best to worst for the side to move
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < job.moves.size(); i++)
+        order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [&job](unsigned int a, unsigned int b) {
+        return getRootMoveScore(job.results[a]) > getRootMoveScore(job.results[b]);
+    });
+
+    int depth = 0;
+    for (unsigned int i = 0; i < job.results.size(); i++)
+        depth = std::max(depth, job.results[i].depth + 1);
+
+    OutputLine out;
+    if (jsonOutput) {
+        out << "{\"position\":" << position.lineNumber;
+        if (!position.id.empty())
+            out << ",\"id\":\"" << position.id << "\"";
+        out << ",\"depth\":" << depth << ",\"nodes\":" << position.nodes
+            << ",\"time\":" << position.time << ",\"moves\":[";
+        for (unsigned int i = 0; i < order.size(); i++) {
+            const SearchResult &result = job.results[order[i]];
+            std::string pv = moveToString(job.moves.get(order[i]));
+            if (result.bestMove != NULL_MOVE)
+                pv += " " + retrievePV(&result.pv);
+            out << (i ? "," : "") << "{\"move\":\"" << moveToString(job.moves.get(order[i]))
+                << "\",\"score\":\"" << scoreToString(getRootMoveScore(result))
+                << "\",\"depth\":" << result.depth + 1
+                << ",\"pv\":\"" << pv << "\"}";
+        }
+        out << "]}";
+        return;
+    }
+
+    out << "position " << position.lineNumber;
+    if (!position.id.empty())
+        out << " id \"" << position.id << "\"";
+    out << " depth " << depth << " nodes " << position.nodes << " time " << position.time << " moves";
+    for (unsigned int i = 0; i < order.size(); i++)
+        out << " " << moveToString(job.moves.get(order[i])) << " " << scoreToString(getRootMoveScore(job.results[order[i]]));
+}
+
+// Converts the score of a child position to the score of the root move that
+// leads to it. Mates are one ply further away from the root.
+static int getRootMoveScore(const SearchResult &childResult) {
+    int score = -childResult.score;
+    if (score >= MAX_PLY_MATE_SCORE)
+        score--;
+    else if (score <= -MAX_PLY_MATE_SCORE)
+        score++;
+    return score;
+}
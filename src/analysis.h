@@ -0,0 +1,84 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ANALYSIS_H__
+#define __ANALYSIS_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "notation.h"
+#include "timeman.h"
+
+// Share of a total node budget spent on the first pass over all positions
+constexpr double SHALLOW_PASS_SHARE = 0.25;
+constexpr int DEFAULT_BUDGET_ROUNDS = 3;
+// Fewest nodes worth starting a search for
+constexpr int MIN_SCHEDULED_NODES = 1000;
+// A position is settled once its best move has held for this many iterations
+// and its score changed by less than this (internal units) in the last one
+constexpr int STABLE_ITERATIONS = 4;
+constexpr int STABLE_SCORE_CHANGE = 20;
+
+/**
+ * @brief Settings for analyzing a file of positions from the command line:
+ *   laser analyze <file> [depth <n> | nodes <n> | movetime <ms>]
+ *       [budget <nodes> [rounds <n>]] [workers <n>] [threads <n>]
+ *       [hash <MB>] [shared]
+ * Each worker searches one position at a time with its own search threads and
+ * per-thread memory. Workers use private transposition tables of the given
+ * size unless "shared" is given, in which case they all use one table.
+ * With a total node budget, the limit is replaced by a shallow pass over all
+ * positions followed by rounds that spend the rest of the budget on the
+ * positions whose searches have not settled yet.
+ */
+struct AnalysisOptions {
+    std::string inputFile;
+    TimeManagement limit;
+    int workers;
+    int threadsPerWorker;
+    uint64_t hashMB;
+    bool sharedHash;
+    uint64_t nodeBudget;
+    int rounds;
+    // Write JSON lines instead of the default output format, where supported
+    bool jsonOutput;
+
+    AnalysisOptions() {
+        limit.searchMode = DEPTH;
+        limit.allotment = 12;
+        limit.maxAllotment = 0;
+        workers = 1;
+        threadsPerWorker = 1;
+        hashMB = 16;
+        sharedHash = false;
+        nodeBudget = 0;
+        rounds = DEFAULT_BUDGET_ROUNDS;
+        jsonOutput = false;
+    }
+};
+
+bool parseAnalysisOptions(int argc, char **argv, AnalysisOptions &options);
+void runAnalysis(const AnalysisOptions &options);
+void runRootMoveScoring(const AnalysisOptions &options);
+bool readPositionFile(const std::string &fileName, std::vector<Board> &boards, uint64_t &errors);
+
+StringView findEPDOperation(StringView operations, const char *opcode);
+bool parseNumber(const char *value, uint64_t &result);
+
+#endif
@@ -0,0 +1,424 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "annotate.h"
+#include "eval.h"
+#include "hash.h"
+#include "match.h"
+#include "output.h"
+#include "search.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+ * @brief Work shared by the annotation workers. Whole games are handed out
+ * through an atomic index, so each game is annotated by a single search whose
+ * hash table carries over from one ply to the next.
+ */
+struct AnnotationJob {
+    const AnalysisOptions *options;
+    std::vector<PGNGame> games;
+    std::atomic<unsigned int> nextGame;
+
+    // Totals for the summary
+    std::atomic<uint64_t> plies;
+    std::atomic<uint64_t> nodes;
+
+    AnnotationJob() : options(nullptr), nextGame(0), plies(0), nodes(0) {}
+};
+
+/**
+ * @brief The search result for one position of a game, with the score from
+ * the point of view of the side to move.
+ */
+struct PlyResult {
+    Move bestMove;
+    int score;
+    int depth;
+    SearchPV pv;
+};
+
+static void annotationWorker(AnnotationJob *job, Search *search);
+static std::string annotateGame(const PGNGame &game, unsigned int gameNumber,
+    const std::vector<Board> &positions, const std::vector<Move> &played,
+    const std::vector<PlyResult> &results, bool jsonOutput);
+static std::string formatPawns(int score, int color);
+static std::string formatCentipawns(int cp, bool withSign);
+static int clampScore(int score);
+static bool isResult(const std::string &token);
+
+
+/*
+ * Splits PGN text into games. Tag pairs, the main line moves and the result
+ * are kept; comments, NAGs, variations, move numbers and escaped lines are
+ * skipped.
+ */
+std::vector<PGNGame> parsePGN(const std::string &text) {
+    std::vector<PGNGame> games;
+    PGNGame game;
+    std::size_t i = 0, n = text.length();
+
+    while (i < n) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '.') {
+            i++;
+        }
+        // A tag pair after movetext starts a new game, even without a result
+        else if (c == '[') {
+            if (!game.moves.empty()) {
+                game.result = "*";
+                games.push_back(game);
+                game = PGNGame();
+            }
+            // [Name "Value"], where the value may contain escaped quotes
+            std::size_t open = text.find('"', i);
+            if (open == std::string::npos)
+                break;
+            std::size_t close = open + 1;
+            while (close < n && text[close] != '"')
+                close += (text[close] == '\\') ? 2 : 1;
+            std::size_t end = text.find(']', std::min(close, n));
+
+            std::string name = text.substr(i + 1, open - i - 1);
+            name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+            game.tags.push_back(std::make_pair(name, text.substr(open + 1, std::min(close, n) - open - 1)));
+            i = (end == std::string::npos) ? n : end + 1;
+        }
+        else if (c == '{') {
+            std::size_t end = text.find('}', i);
+            i = (end == std::string::npos) ? n : end + 1;
+        }
+        // Line comments, and escaped lines starting with %
+        else if (c == ';' || (c == '%' && (i == 0 || text[i-1] == '\n'))) {
+            std::size_t end = text.find('\n', i);
+            i = (end == std::string::npos) ? n : end + 1;
+        }
+        // Variations may nest and contain comments
+        else if (c == '(') {
+            int level = 0;
+            for (; i < n; i++) {
+                if (text[i] == '{') {
+                    std::size_t end = text.find('}', i);
+                    i = (end == std::string::npos) ? n - 1 : end;
+                }
+                else if (text[i] == '(')
+                    level++;
+                else if (text[i] == ')' && --level == 0)
+                    break;
+            }
+            i++;
+        }
+        else {
+            std::size_t end = i;
+            while (end < n && std::strchr(" \t\r\n{}()[];", text[end]) == nullptr)
+                end++;
+            std::string token = text.substr(i, end - i);
+            i = end;
+
+            if (isResult(token)) {
+                game.result = token;
+                games.push_back(game);
+                game = PGNGame();
+                continue;
+            }
+            // Drop move numbers such as "12." or "12...", which may be
+            // attached to the move that follows
+            std::size_t start = 0;
+            while (start < token.length() && std::isdigit((unsigned char) token[start]))
+                start++;
+            if (start < token.length() && token[start] == '.') {
+                while (start < token.length() && token[start] == '.')
+                    start++;
+                token = token.substr(start);
+            }
+            else if (start == token.length())
+                token.clear();
+
+            if (!token.empty() && token[0] != '$')
+                game.moves.push_back(token);
+        }
+    }
+
+    if (!game.moves.empty()) {
+        game.result = "*";
+        games.push_back(game);
+    }
+    return games;
+}
+
+/*
+ * Annotates every game of a PGN file. Each game is replayed, then searched
+ * from its final position back to the first, so that the transposition table
+ * already holds the main line of the game when the earlier plies are
+ * searched. The score of a played move is the negated score of the position
+ * it leads to, which is therefore always searched first.
+ * The default output is the game as PGN with a comment after each move; with
+ * "json" there is one line per ply instead.
+ */
+void runAnnotation(const AnalysisOptions &options) {
+    AnnotationJob job;
+    job.options = &options;
+
+    std::ifstream file(options.inputFile, std::ios::binary);
+    if (!file) {
+        cerr << "Could not open " << options.inputFile << endl;
+        return;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    job.games = parsePGN(contents.str());
+
+    // A shared table is not aged during the run, so that entries of games
+    // annotated by other workers stay fresh
+    Hash *sharedTable = nullptr;
+    if (options.sharedHash)
+        sharedTable = new Hash(options.hashMB);
+
+    int workers = std::max(1, std::min(options.workers, (int) job.games.size()));
+    std::vector<Search *> searches;
+    for (int i = 0; i < workers; i++) {
+        Search *search = new Search(sharedTable);
+        search->setSilent(true);
+        search->setNumThreads(options.threadsPerWorker);
+        if (sharedTable == nullptr)
+            search->setHashSize(options.hashMB);
+        searches.push_back(search);
+    }
+
+    auto startTime = ChessClock::now();
+
+    std::vector<std::thread> workerThreads;
+    for (int i = 0; i < workers; i++)
+        workerThreads.push_back(std::thread(annotationWorker, &job, searches[i]));
+    for (int i = 0; i < workers; i++)
+        workerThreads[i].join();
+
+    uint64_t time = std::max((uint64_t) 1, getTimeElapsed(startTime));
+
+    for (unsigned int i = 0; i < searches.size(); i++)
+        delete searches[i];
+    delete sharedTable;
+
+    cerr << "Games     : " << job.games.size() << endl;
+    cerr << "Plies     : " << job.plies << endl;
+    cerr << "Time      : " << time << " ms" << endl;
+    cerr << "Nodes     : " << job.nodes << endl;
+    cerr << "NPS       : " << 1000 * job.nodes / time << endl;
+    cerr << "Plies/sec : " << 1000 * job.plies / time << endl;
+}
+
+
+static void annotationWorker(AnnotationJob *job, Search *search) {
+    TimeManagement limit = job->options->limit;
+    MoveList movesToSearch;
+
+    for (unsigned int g = job->nextGame++; g < job->games.size(); g = job->nextGame++) {
+        const PGNGame &game = job->games[g];
+
+        Board board = fenToBoard(STARTPOS);
+        for (unsigned int i = 0; i < game.tags.size(); i++) {
+            if (game.tags[i].first == "FEN")
+                board = fenToBoard(game.tags[i].second);
+        }
+
+        // Replay the game, keeping each position and the repetition history
+        // leading up to it. Annotation stops at the first illegal move.
+        std::vector<Board> positions;
+        std::vector<TwoFoldStack> histories;
+        std::vector<Move> played;
+        TwoFoldStack history;
+        history.setRootEnd();
+        positions.push_back(board);
+        histories.push_back(history);
+        for (unsigned int i = 0; i < game.moves.size(); i++) {
+            Move m = sanToMove(game.moves[i], board);
+            if (m == NULL_MOVE) {
+                OutputLine() << "info string game " << g+1 << ": illegal move " << game.moves[i];
+                break;
+            }
+            const int color = board.getPlayerToMove();
+            pushHistory(history, board, m);
+            board.doMove(m, color);
+            history.setRootEnd();
+
+            played.push_back(m);
+            positions.push_back(board);
+            histories.push_back(history);
+        }
+
+        // Search from the last position back to the first
+        std::vector<PlyResult> results(positions.size());
+        for (int ply = (int) positions.size() - 1; ply >= 0; ply--) {
+            *search->getTwoFoldStackPointer() = histories[ply];
+
+            search->isStop = false;
+            search->stopSignal = false;
+            search->getBestMoveThreader(&positions[ply], &limit, &movesToSearch);
+            search->isStop = true;
+            search->stopSignal = true;
+
+            const SearchResult &result = search->getResult();
+            results[ply].bestMove = result.bestMove;
+            results[ply].score = result.score;
+            results[ply].depth = result.depth;
+            results[ply].pv = result.pv;
+            job->nodes += result.nodes;
+            job->plies++;
+        }
+
+        writeLine(annotateGame(game, g+1, positions, played, results, job->options->jsonOutput));
+    }
+}
+
+// Formats one annotated game as a block of lines, so that games finished by
+// different workers are never interleaved in the output
+static std::string annotateGame(const PGNGame &game, unsigned int gameNumber,
+        const std::vector<Board> &positions, const std::vector<Move> &played,
+        const std::vector<PlyResult> &results, bool jsonOutput) {
+    std::ostringstream out;
+
+    if (!jsonOutput) {
+        for (unsigned int i = 0; i < game.tags.size(); i++)
+            out << "[" << game.tags[i].first << " \"" << game.tags[i].second << "\"]\n";
+        out << "\n";
+    }
+
+    std::string line;
+    for (unsigned int ply = 0; ply < played.size(); ply++) {
+        const Board &b = positions[ply];
+        const int color = b.getPlayerToMove();
+        const PlyResult &best = results[ply];
+        const PlyResult &after = results[ply+1];
+        // The position after the move was searched as the root, so its mate
+        // scores are one ply short when seen from this position
+        int playedScore = -after.score;
+        if (playedScore >= MAX_PLY_MATE_SCORE)
+            playedScore--;
+        else if (playedScore <= -MAX_PLY_MATE_SCORE)
+            playedScore++;
+        int loss = 0;
+        if (played[ply] != best.bestMove)
+            loss = std::max(0, clampScore(best.score) - clampScore(playedScore));
+        loss = loss * 100 / PIECE_VALUES[EG][PAWNS];
+
+        std::string san = moveToSAN(played[ply], b);
+        std::string bestSAN = (best.bestMove == NULL_MOVE) ? "none" : moveToSAN(best.bestMove, b);
+
+        if (jsonOutput) {
+            out << "{\"game\":" << gameNumber
+                << ",\"ply\":" << ply + 1
+                << ",\"fen\":\"" << boardToFEN(b) << "\""
+                << ",\"move\":\"" << san << "\""
+                << ",\"best\":\"" << bestSAN << "\""
+                << ",\"score\":\"" << scoreToString(best.score) << "\""
+                << ",\"played_score\":\"" << scoreToString(playedScore) << "\""
+                << ",\"loss\":" << loss
+                << ",\"depth\":" << best.depth
+                << ",\"pv\":\"" << retrievePV(&best.pv) << "\"}";
+            if (ply + 1 < played.size())
+                out << "\n";
+            continue;
+        }
+
+        // Movetext: the score after the played move from White's point of
+        // view, and the engine's choice if it differs
+        std::ostringstream token;
+        if (color == WHITE)
+            token << b.getMoveNumber() << ". ";
+        else if (ply == 0)
+            token << b.getMoveNumber() << "... ";
+        // Mates and stalemates on the board need no search depth
+        token << san << " {";
+        if (playedScore == MATE_SCORE - 1)
+            token << "mate";
+        else if (after.depth == 0)
+            token << formatPawns(playedScore, color);
+        else
+            token << formatPawns(playedScore, color) << "/" << after.depth;
+        if (played[ply] != best.bestMove)
+            token << "; best " << bestSAN << " " << formatPawns(best.score, color)
+                  << ", loss " << formatCentipawns(loss, false);
+        token << "}";
+
+        appendMovetext(out, line, token.str());
+    }
+
+    if (!jsonOutput) {
+        appendMovetext(out, line, game.result);
+        out << line << "\n";
+    }
+    return out.str();
+}
+
+// Adds the words of text to the current movetext line, writing out the line
+// first whenever it would grow past PGN_LINE_LENGTH
+void appendMovetext(std::ostream &out, std::string &line, const std::string &text) {
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word) {
+        if (!line.empty() && line.length() + 1 + word.length() > PGN_LINE_LENGTH) {
+            out << line << "\n";
+            line.clear();
+        }
+        if (!line.empty())
+            line += " ";
+        line += word;
+    }
+}
+
+// Formats a score for the given side to move from White's point of view, in
+// pawns as "+0.35", or as "#3" / "#-3" for mates
+static std::string formatPawns(int score, int color) {
+    if (color == BLACK)
+        score = -score;
+
+    std::ostringstream out;
+    if (score >= MAX_PLY_MATE_SCORE)
+        out << "#" << (MATE_SCORE - score + 1) / 2;
+    else if (score <= -MAX_PLY_MATE_SCORE)
+        out << "#-" << (MATE_SCORE + score + 1) / 2;
+    else
+        out << formatCentipawns(score * 100 / PIECE_VALUES[EG][PAWNS], true);
+    return out.str();
+}
+
+static std::string formatCentipawns(int cp, bool withSign) {
+    std::ostringstream out;
+    if (withSign || cp < 0)
+        out << (cp < 0 ? "-" : "+");
+    out << abs(cp) / 100 << "." << (abs(cp) % 100 < 10 ? "0" : "") << abs(cp) % 100;
+    return out.str();
+}
+
+// Mate scores are capped so that missing a mate costs a bounded amount
+static int clampScore(int score) {
+    return std::max(-NEAR_MATE_SCORE, std::min(NEAR_MATE_SCORE, score));
+}
+
+static bool isResult(const std::string &token) {
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
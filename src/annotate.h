@@ -0,0 +1,45 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ANNOTATE_H__
+#define __ANNOTATE_H__
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "analysis.h"
+
+// Movetext lines of annotated PGN are wrapped at this length
+constexpr unsigned int PGN_LINE_LENGTH = 79;
+
+/**
+ * @brief A game read from a PGN file: its tag pairs, the moves of the main
+ * line in SAN, and the result. Comments, NAGs and variations are dropped.
+ */
+struct PGNGame {
+    std::vector<std::pair<std::string, std::string>> tags;
+    std::vector<std::string> moves;
+    std::string result;
+};
+
+std::vector<PGNGame> parsePGN(const std::string &text);
+void runAnnotation(const AnalysisOptions &options);
+void appendMovetext(std::ostream &out, std::string &line, const std::string &text);
+
+#endif
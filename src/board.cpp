@@ -23,6 +23,7 @@
 #include "board.h"
 #include "bbinit.h"
 #include "eval.h"
+#include "instrument.h"
 #include "uci.h"
 
 
@@ -41,10 +42,10 @@ void initZobristTable() {
         zobristTable[i] = rng();
 
     Board b;
-    int *mailbox = b.getMailbox();
+    int mailbox[64];
+    b.getMailbox(mailbox);
     b.initZobristKey(mailbox);
     startPosZobristKey = b.getZobristKey();
-    delete[] mailbox;
 }
 
 // Magic tables, initialized in bbinit.cpp
@@ -126,6 +127,29 @@ Board::Board(int *mailboxBoard, bool _whiteCanKCastle, bool _blackCanKCastle,
     kingSqs[BLACK] = bitScanForward(pieces[BLACK][KINGS]);
 }
 
+// Create a board directly from its bitboards, without going through a
+// mailbox, e.g. for positions read from a packed file
+Board::Board(const uint64_t bitboards[2][6], uint8_t _castlingRights, uint16_t _epCaptureFile,
+        int _fiftyMoveCounter, int _moveNumber, int _playerToMove) {
+    for (int color = WHITE; color <= BLACK; color++) {
+        allPieces[color] = 0;
+        for (int i = 0; i < 6; i++) {
+            pieces[color][i] = bitboards[color][i];
+            allPieces[color] |= bitboards[color][i];
+        }
+    }
+
+    epCaptureFile = _epCaptureFile;
+    playerToMove = _playerToMove;
+    moveNumber = _moveNumber;
+    castlingRights = _castlingRights;
+    fiftyMoveCounter = _fiftyMoveCounter;
+    initZobristKey();
+
+    kingSqs[WHITE] = bitScanForward(pieces[WHITE][KINGS]);
+    kingSqs[BLACK] = bitScanForward(pieces[BLACK][KINGS]);
+}
+
 Board::~Board() {}
 
 Board Board::staticCopy() const {
@@ -344,6 +368,67 @@ void Board::doMove(Move m, int color) {
     zobristKey ^= zobristTable[768];
 }
 
+/*
+ * Computes the Zobrist key that doMove would leave, following the same
+ * updates without touching the board, so that the hash table entry of a
+ * child position can be fetched before the move is made.
+ */
+uint64_t Board::getZobristKeyAfter(Move m, int color) const {
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+    int pieceID = getPieceOnSquare(color, startSq);
+    uint64_t key = zobristKey ^ zobristTable[768];
+    uint8_t newCastlingRights = castlingRights;
+    uint16_t newEPCaptureFile = NO_EP_POSSIBLE;
+
+    if (isCastle(m)) {
+        int rookStart = (endSq > startSq) ? startSq + 3 : startSq - 4;
+        int rookEnd = (endSq > startSq) ? startSq + 1 : startSq - 1;
+        key ^= zobristTable[384*color + 64*KINGS + startSq];
+        key ^= zobristTable[384*color + 64*KINGS + endSq];
+        key ^= zobristTable[384*color + 64*ROOKS + rookStart];
+        key ^= zobristTable[384*color + 64*ROOKS + rookEnd];
+    }
+    else {
+        int endPiece = isPromotion(m) ? getPromotion(m) : pieceID;
+        key ^= zobristTable[384*color + 64*pieceID + startSq];
+        key ^= zobristTable[384*color + 64*endPiece + endSq];
+
+        if (isEP(m))
+            key ^= zobristTable[384*(color^1) + epVictimSquare(color^1, epCaptureFile)];
+        else if (isCapture(m))
+            key ^= zobristTable[384*(color^1) + 64*getPieceOnSquare(color^1, endSq) + endSq];
+        else if (getFlags(m) == MOVE_DOUBLE_PAWN)
+            newEPCaptureFile = startSq & 7;
+    }
+
+    // Castling rights change as in doMove, from the rooks left on the board
+    if (pieceID == KINGS)
+        newCastlingRights &= (color == WHITE) ? ~WHITECASTLE : ~BLACKCASTLE;
+    else if (isCapture(m) || pieceID == ROOKS) {
+        uint64_t rooks[2] = {pieces[WHITE][ROOKS], pieces[BLACK][ROOKS]};
+        if (pieceID == ROOKS)
+            rooks[color] ^= indexToBit(startSq) | indexToBit(endSq);
+        else if (isPromotion(m) && getPromotion(m) == ROOKS)
+            rooks[color] |= indexToBit(endSq);
+        if (isCapture(m) && !isEP(m))
+            rooks[color^1] &= ~indexToBit(endSq);
+
+        if ((rooks[WHITE] & 0x80) == 0)
+            newCastlingRights &= ~WHITEKSIDE;
+        if ((rooks[WHITE] & 1) == 0)
+            newCastlingRights &= ~WHITEQSIDE;
+        if (((rooks[BLACK] >> 56) & 0x80) == 0)
+            newCastlingRights &= ~BLACKKSIDE;
+        if (((rooks[BLACK] >> 56) & 1) == 0)
+            newCastlingRights &= ~BLACKQSIDE;
+    }
+
+    key ^= zobristTable[769 + castlingRights] ^ zobristTable[769 + newCastlingRights];
+    key ^= zobristTable[785 + epCaptureFile] ^ zobristTable[785 + newEPCaptureFile];
+    return key;
+}
+
 bool Board::doPseudoLegalMove(Move m, int color) {
     doMove(m, color);
     // Pseudo-legal moves require a check for legality
@@ -485,6 +570,7 @@ void Board::getAllPseudoLegalMoves(MoveList &legalMoves, int color) const {
  * King moves
  */
 void Board::getPseudoLegalQuiets(MoveList &quiets, int color) const {
+    INSTRUMENT_SCOPE(IC_GEN_QUIETS);
     addCastlesToList(quiets, color);
 
     addPieceMovesToList<MOVEGEN_QUIETS>(quiets, color);
@@ -506,6 +592,7 @@ void Board::getPseudoLegalQuiets(MoveList &quiets, int color) const {
  * Queen captures
  */
 void Board::getPseudoLegalCaptures(MoveList &captures, int color, bool includePromotions) const {
+    INSTRUMENT_SCOPE(IC_GEN_CAPTURES);
     uint64_t otherPieces = allPieces[color^1];
 
     uint64_t kingMoves = getKingSquares(kingSqs[color]);
@@ -518,6 +605,7 @@ void Board::getPseudoLegalCaptures(MoveList &captures, int color, bool includePr
 
 // Generates all queen promotions for quiescence search
 void Board::getPseudoLegalPromotions(MoveList &moves, int color) const {
+    INSTRUMENT_SCOPE(IC_GEN_PROMOTIONS);
     uint64_t otherPieces = allPieces[color^1];
 
     uint64_t pawns = pieces[color][PAWNS];
@@ -583,6 +671,7 @@ void Board::getPseudoLegalPromotions(MoveList &moves, int color) const {
  * For simplicity, promotions and en passant are left out of this function.
  */
 void Board::getPseudoLegalChecks(MoveList &checks, int color) const {
+    INSTRUMENT_SCOPE(IC_GEN_CHECKS);
     int kingSq = kingSqs[color^1];
     // Square parity for knight and bishop moves
     uint64_t kingParity = (pieces[color^1][KINGS] & LIGHT) ? LIGHT : DARK;
@@ -707,6 +796,7 @@ void Board::getPseudoLegalChecks(MoveList &checks, int color) const {
 // Optimizations include looking for double check (king moves only),
 // otherwise we can only capture the checker or block if it is an xray piece
 void Board::getPseudoLegalCheckEscapes(MoveList &escapes, int color) const {
+    INSTRUMENT_SCOPE(IC_GEN_EVASIONS);
     int kingSq = kingSqs[color];
     uint64_t otherPieces = allPieces[color^1];
     uint64_t attackMap = getAttackMap(color^1, kingSq);
@@ -1260,6 +1350,7 @@ uint64_t Board::getLeastValuableAttacker(uint64_t attackers, int color, int &pie
 // Calculates whether the Static Exchange Evaluation for a move is greater than or equal to the cutoff.
 // Minimax algorithm based on Stockfish's SEE implementation.
 bool Board::isSEEAbove(int color, Move m, int cutoff) const {
+    INSTRUMENT_SCOPE(IC_SEE);
     static constexpr int SEE_PIECE_VALS[6] = {100, 400, 400, 600, 1150, 0};
 
     // Assume the SEE score for EP captures and castling is 0
@@ -1491,6 +1582,12 @@ int Board::getKingSq(int color) const {
 
 int *Board::getMailbox() const {
     int *result = new int[64];
+    getMailbox(result);
+    return result;
+}
+
+// Fills a caller-provided array of 64 squares, avoiding the allocation
+void Board::getMailbox(int *result) const {
     for (int i = 0; i < 64; i++) {
         result[i] = -1;
     }
@@ -1508,7 +1605,6 @@ int *Board::getMailbox() const {
             bitboard &= bitboard - 1;
         }
     }
-    return result;
 }
 
 uint64_t Board::getZobristKey() const {
@@ -1527,3 +1623,55 @@ void Board::initZobristKey(int *mailbox) {
     zobristKey ^= zobristTable[769 + castlingRights];
     zobristKey ^= zobristTable[785 + epCaptureFile];
 }
+
+// Same as above, computed from the bitboards
+void Board::initZobristKey() {
+    zobristKey = 0;
+    for (int i = 0; i < 12; i++) {
+        uint64_t bitboard = pieces[i/6][i%6];
+        while (bitboard) {
+            zobristKey ^= zobristTable[i * 64 + bitScanForward(bitboard)];
+            bitboard &= bitboard - 1;
+        }
+    }
+    if (playerToMove == BLACK)
+        zobristKey ^= zobristTable[768];
+    zobristKey ^= zobristTable[769 + castlingRights];
+    zobristKey ^= zobristTable[785 + epCaptureFile];
+}
+
+/*
+ * Performs a PERFT (performance test). Useful for testing/debugging
+ * PERFT n counts the number of possible positions after n moves by either side,
+ * ex. PERFT 4 = # of positions after 2 moves from each side
+ *
+ * 7/8/15: PERFT 5, 1.46 s (i5-2450m)
+ * 7/11/15: PERFT 5, 1.22 s (i5-2450m)
+ * 7/13/15: PERFT 5, 1.08 s (i5-2450m)
+ * 7/14/15: PERFT 5, 0.86 s (i5-2450m)
+ * 7/17/15: PERFT 5, 0.32 s (i5-2450m)
+ * 8/7/15: PERFT 5, 0.25 s, PERFT 6, 6.17 s (i5-5200u)
+ * 8/8/15: PERFT 6, 5.90 s (i5-5200u)
+ * 8/11/15: PERFT 6, 5.20 s (i5-5200u)
+ */
+uint64_t perft(Board &b, int color, int depth, uint64_t &captures) {
+    if (depth == 0)
+        return 1;
+
+    uint64_t nodes = 0;
+
+    MoveList pl;
+    b.getAllPseudoLegalMoves(pl, color);
+    for (unsigned int i = 0; i < pl.size(); i++) {
+        Board copy = b.staticCopy();
+        if (!copy.doPseudoLegalMove(pl.get(i), color))
+            continue;
+
+        if (isCapture(pl.get(i)))
+            captures++;
+
+        nodes += perft(copy, color^1, depth-1, captures);
+    }
+
+    return nodes;
+}
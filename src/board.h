@@ -81,6 +81,8 @@ public:
     Board(int *mailboxBoard, bool _whiteCanKCastle, bool _blackCanKCastle,
           bool _whiteCanQCastle, bool _blackCanQCastle, uint16_t _epCaptureFile,
           int _fiftyMoveCounter, int _moveNumber, int _playerToMove);
+    Board(const uint64_t bitboards[2][6], uint8_t _castlingRights, uint16_t _epCaptureFile,
+          int _fiftyMoveCounter, int _moveNumber, int _playerToMove);
     ~Board();
     Board staticCopy() const;
 
@@ -129,6 +131,8 @@ public:
     uint64_t getBPawnCaptures(uint64_t pawns) const;
     uint64_t getKnightSquares(int single) const;
     uint64_t getBishopSquares(int single, uint64_t occ) const;
+    uint64_t getRookSquares(int single, uint64_t occ) const;
+    uint64_t getQueenSquares(int single, uint64_t occ) const;
     uint64_t getKingSquares(int single) const;
 
     // Getter methods
@@ -146,9 +150,13 @@ public:
     uint64_t getAllPieces(int color) const;
     int getKingSq(int color) const;
     int *getMailbox() const;
+    void getMailbox(int *mailbox) const;
     uint64_t getZobristKey() const;
+    // The key of the position after the move, without making the move
+    uint64_t getZobristKeyAfter(Move m, int color) const;
 
     void initZobristKey(int *mailbox);
+    void initZobristKey();
 
 private:
     // Bitboards for all white or all black pieces
@@ -199,10 +207,10 @@ private:
     uint64_t getBPawnLeftCaptures(uint64_t pawns) const;
     uint64_t getWPawnRightCaptures(uint64_t pawns) const;
     uint64_t getBPawnRightCaptures(uint64_t pawns) const;
-    uint64_t getRookSquares(int single, uint64_t occ) const;
-    uint64_t getQueenSquares(int single, uint64_t occ) const;
     uint64_t getOccupancy() const;
     int epVictimSquare(int victimColor, uint16_t file) const;
 };
 
+uint64_t perft(Board &b, int color, int depth, uint64_t &captures);
+
 #endif
@@ -0,0 +1,65 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include "board.h"
+#include "common.h"
+
+// Number of random keys making up a Polyglot position key
+constexpr int POLYGLOT_RANDOM_COUNT = 781;
+// Polyglot key of the starting position, used to check the key table
+constexpr uint64_t POLYGLOT_STARTPOS_KEY = 0x463B96181691FC9CULL;
+
+/**
+ * @brief An opening book in the Polyglot .bin format, memory-mapped and
+ * searched in place. Entries are 16 big-endian bytes sorted by position key:
+ * key, move, weight, and a learn field which is ignored.
+ */
+class PolyglotBook {
+public:
+    PolyglotBook();
+    PolyglotBook(const PolyglotBook &other) = delete;
+    PolyglotBook& operator=(const PolyglotBook &other) = delete;
+    ~PolyglotBook();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return entries != nullptr; }
+
+    uint64_t getKey(const Board &b) const;
+    Move probe(const Board &b, bool bestOnly);
+
+private:
+    const uint8_t *entries;
+    uint64_t numEntries;
+    uint64_t mappedSize;
+    // Guards the generator used for weighted move selection
+    std::mutex rngMutex;
+    std::mt19937_64 rng;
+
+    uint64_t getEntryKey(uint64_t i) const;
+    Move toLegalMove(const Board &b, uint16_t bookMove) const;
+};
+
+#endif
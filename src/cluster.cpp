@@ -0,0 +1,482 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "cluster.h"
+#include "notation.h"
+#include "timeman.h"
+
+using std::cerr;
+using std::endl;
+
+// Message types. Every message is a ClusterMessageHeader followed by length
+// bytes of payload.
+constexpr uint32_t CLUSTER_POSITION = 1;
+constexpr uint32_t CLUSTER_STOP = 2;
+constexpr uint32_t CLUSTER_ENTRIES = 3;
+constexpr uint32_t CLUSTER_RESULT = 4;
+
+struct ClusterMessageHeader {
+    uint32_t type;
+    uint32_t length;
+};
+
+// Starts a search of the position on a helper
+struct ClusterPosition {
+    uint32_t searchID;
+    char fen[MAX_FEN_LENGTH];
+    // Positions of the game so far, for repetition detection
+    TwoFoldStack history;
+};
+
+// A helper's root result, sent when it is told to stop
+struct ClusterResult {
+    uint32_t searchID;
+    Move bestMove;
+    Move ponder;
+    int32_t score;
+    int32_t depth;
+    uint64_t nodes;
+};
+
+/**
+ * @brief A helper process connected to the coordinator. The coordinator reads
+ * from each helper on its own thread.
+ */
+struct ClusterPeer {
+    int fd;
+    std::mutex writeMutex;
+    std::thread readerThread;
+    // These are guarded by the cluster's peerMutex
+    bool isAlive;
+    bool isSearching;
+    bool hasResult;
+    ClusterResult result;
+
+    ClusterPeer(int _fd) : fd(_fd), isAlive(true), isSearching(false), hasResult(false) {}
+};
+
+#ifndef _WIN32
+static bool sendMessage(int fd, std::mutex &writeMutex, uint32_t type, const void *data, uint32_t length);
+static bool receiveMessage(int fd, uint32_t &type, std::vector<char> &payload);
+static bool writeFully(int fd, const void *buffer, std::size_t length);
+static bool readFully(int fd, void *buffer, std::size_t length);
+static bool initSocketAddress(const std::string &path, sockaddr_un &address);
+#endif
+
+
+Cluster::Cluster() {
+    listener = -1;
+    transpositionTable = nullptr;
+    searchID = 0;
+}
+
+Cluster::~Cluster() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool Cluster::open(const std::string &path, Hash *table) {
+    (void) path;
+    (void) table;
+    cerr << "Cluster search is not supported on this platform" << endl;
+    return false;
+}
+
+void Cluster::close() {}
+
+int Cluster::getNumHelpers() {
+    return 0;
+}
+
+void Cluster::search(Search &search, const Board *b, TimeManagement *timeParams, SearchResult &combined) {
+    MoveList movesToSearch;
+    search.getBestMoveThreader(b, timeParams, &movesToSearch);
+    combined = search.getResult();
+}
+
+void runClusterHelper(const AnalysisOptions &options) {
+    (void) options;
+    cerr << "Cluster search is not supported on this platform" << endl;
+}
+
+#else
+
+// Listens on path for helper processes, which share entries with table
+bool Cluster::open(const std::string &path, Hash *table) {
+    close();
+
+    sockaddr_un address;
+    if (!initSocketAddress(path, address))
+        return false;
+
+    // A helper that disconnects early must not kill the coordinator
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener == -1 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0
+     || listen(listener, SOMAXCONN) != 0) {
+        cerr << "Could not listen on " << path << ": " << strerror(errno) << endl;
+        if (listener != -1)
+            ::close(listener);
+        listener = -1;
+        return false;
+    }
+
+    socketPath = path;
+    transpositionTable = table;
+    acceptThread = std::thread(&Cluster::acceptHelpers, this);
+    return true;
+}
+
+void Cluster::close() {
+    if (listener == -1)
+        return;
+
+    // Shutting down the sockets wakes up the threads blocked on them
+    shutdown(listener, SHUT_RDWR);
+    acceptThread.join();
+    ::close(listener);
+    listener = -1;
+    unlink(socketPath.c_str());
+
+    for (ClusterPeer *peer : peers) {
+        shutdown(peer->fd, SHUT_RDWR);
+        peer->readerThread.join();
+        ::close(peer->fd);
+        delete peer;
+    }
+    peers.clear();
+}
+
+int Cluster::getNumHelpers() {
+    std::lock_guard<std::mutex> lock(peerMutex);
+    int numHelpers = 0;
+    for (ClusterPeer *peer : peers)
+        numHelpers += peer->isAlive;
+    return numHelpers;
+}
+
+/*
+ * Searches the position on this process and all helpers. Deep hash entries of
+ * every process are sent to the others while the search runs. When our own
+ * search ends, the helpers are stopped and the result of the deepest completed
+ * search, or the best score at equal depth, is returned.
+ */
+void Cluster::search(Search &search, const Board *b, TimeManagement *timeParams, SearchResult &combined) {
+    ChessTime startTime = ChessClock::now();
+    ClusterPosition position;
+    writeFEN(*b, position.fen);
+    position.history = *search.getTwoFoldStackPointer();
+    {
+        std::lock_guard<std::mutex> lock(peerMutex);
+        position.searchID = ++searchID;
+        for (ClusterPeer *peer : peers) {
+            peer->isSearching = peer->isAlive;
+            peer->hasResult = false;
+        }
+    }
+    sendToHelpers(CLUSTER_POSITION, &position, sizeof(position));
+
+    transpositionTable->setShareDepth(CLUSTER_SHARE_DEPTH);
+    std::atomic<bool> isSearching(true);
+    std::thread sender([this, &isSearching] {
+        std::vector<HashEntry> entries;
+        while (isSearching) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(CLUSTER_SEND_INTERVAL));
+            transpositionTable->takeSharedEntries(entries);
+            if (!entries.empty())
+                sendToHelpers(CLUSTER_ENTRIES, entries.data(), entries.size() * sizeof(HashEntry));
+        }
+    });
+
+    MoveList movesToSearch;
+    search.getBestMoveThreader(b, timeParams, &movesToSearch);
+
+    isSearching = false;
+    sender.join();
+    transpositionTable->setShareDepth(MAX_DEPTH + 1);
+    sendToHelpers(CLUSTER_STOP, &position.searchID, sizeof(position.searchID));
+
+    int resultTimeout = CLUSTER_RESULT_TIMEOUT;
+    if (timeParams->searchMode == TIME || timeParams->searchMode == MOVETIME) {
+        int timeLimit = (timeParams->searchMode == TIME) ? timeParams->maxAllotment : timeParams->allotment;
+        resultTimeout = std::max(CLUSTER_MIN_RESULT_TIMEOUT, timeLimit - (int) getTimeElapsed(startTime));
+    }
+
+    combined = search.getResult();
+    std::unique_lock<std::mutex> lock(peerMutex);
+    resultReceived.wait_for(lock, std::chrono::milliseconds(resultTimeout), [this] {
+        for (ClusterPeer *peer : peers) {
+            if (peer->isAlive && peer->isSearching)
+                return false;
+        }
+        return true;
+    });
+
+    for (ClusterPeer *peer : peers) {
+        const ClusterResult &result = peer->result;
+        if (!peer->hasResult || result.searchID != position.searchID || result.bestMove == NULL_MOVE)
+            continue;
+        combined.nodes += result.nodes;
+        if (result.depth > combined.depth || (result.depth == combined.depth && result.score > combined.score)) {
+            combined.bestMove = result.bestMove;
+            combined.ponder = result.ponder;
+            combined.score = result.score;
+            combined.depth = result.depth;
+            combined.pv.pv[0] = result.bestMove;
+            combined.pv.pv[1] = result.ponder;
+            combined.pv.pvLength = (result.ponder == NULL_MOVE) ? 1 : 2;
+        }
+    }
+}
+
+void Cluster::acceptHelpers() {
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        ClusterPeer *peer = new ClusterPeer(fd);
+        std::lock_guard<std::mutex> lock(peerMutex);
+        peers.push_back(peer);
+        peer->readerThread = std::thread(&Cluster::receiveFromHelper, this, peer);
+    }
+}
+
+// Takes in a helper's shared entries, passing them on to the other helpers,
+// and its results
+void Cluster::receiveFromHelper(ClusterPeer *peer) {
+    uint32_t type;
+    std::vector<char> payload;
+    while (receiveMessage(peer->fd, type, payload)) {
+        if (type == CLUSTER_ENTRIES) {
+            const HashEntry *entries = (const HashEntry *) payload.data();
+            for (std::size_t i = 0; i < payload.size() / sizeof(HashEntry); i++)
+                transpositionTable->addSharedEntry(entries[i]);
+            sendToHelpers(CLUSTER_ENTRIES, payload.data(), payload.size(), peer);
+        }
+        else if (type == CLUSTER_RESULT && payload.size() == sizeof(ClusterResult)) {
+            std::lock_guard<std::mutex> lock(peerMutex);
+            std::memcpy(&peer->result, payload.data(), sizeof(ClusterResult));
+            peer->hasResult = true;
+            peer->isSearching = false;
+            resultReceived.notify_all();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(peerMutex);
+    peer->isAlive = false;
+    resultReceived.notify_all();
+}
+
+void Cluster::sendToHelpers(uint32_t type, const void *data, uint32_t length, const ClusterPeer *except) {
+    // Peers are only freed by close(), so they can be written to without
+    // holding the lock
+    std::vector<ClusterPeer *> recipients;
+    {
+        std::lock_guard<std::mutex> lock(peerMutex);
+        for (ClusterPeer *peer : peers) {
+            if (peer->isAlive && peer != except)
+                recipients.push_back(peer);
+        }
+    }
+    for (ClusterPeer *peer : recipients)
+        sendMessage(peer->fd, peer->writeMutex, type, data, length);
+}
+
+/*
+ * Runs a helper process for a cluster search:
+ *   laser cluster <socket> [threads <n>] [hash <MB>]
+ * The helper searches each position it is sent until it is told to stop, then
+ * answers with its result. It exits when the coordinator goes away.
+ */
+void runClusterHelper(const AnalysisOptions &options) {
+    sockaddr_un address;
+    if (!initSocketAddress(options.inputFile, address))
+        return;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+        cerr << "Could not connect to " << options.inputFile << ": " << strerror(errno) << endl;
+        if (fd != -1)
+            ::close(fd);
+        return;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Hash table(options.hashMB);
+    Search search(&table);
+    search.setSilent(true);
+    search.setNumThreads(options.threadsPerWorker);
+
+    std::mutex writeMutex;
+    Board board;
+    uint32_t currentID = 0;
+    uint64_t searches = 0, entriesReceived = 0;
+    std::thread searchThread, sender;
+    std::atomic<bool> isSearching(false);
+
+    auto finishSearch = [&] {
+        if (!searchThread.joinable())
+            return;
+        search.isStop = true;
+        search.stopSignal = true;
+        searchThread.join();
+        isSearching = false;
+        sender.join();
+        table.setShareDepth(MAX_DEPTH + 1);
+    };
+
+    uint32_t type;
+    std::vector<char> payload;
+    while (receiveMessage(fd, type, payload)) {
+        if (type == CLUSTER_POSITION && payload.size() == sizeof(ClusterPosition)) {
+            finishSearch();
+            const ClusterPosition *position = (const ClusterPosition *) payload.data();
+            currentID = position->searchID;
+            board = fenToBoard(position->fen);
+            *search.getTwoFoldStackPointer() = position->history;
+            searches++;
+
+            // Search until told to stop
+            search.isStop = false;
+            search.stopSignal = false;
+            table.setShareDepth(CLUSTER_SHARE_DEPTH);
+            searchThread = std::thread([&search, &board] {
+                TimeManagement limit;
+                limit.searchMode = DEPTH;
+                limit.allotment = MAX_DEPTH;
+                limit.maxAllotment = 0;
+                MoveList movesToSearch;
+                search.getBestMoveThreader(&board, &limit, &movesToSearch);
+            });
+
+            isSearching = true;
+            sender = std::thread([&] {
+                std::vector<HashEntry> entries;
+                while (isSearching) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(CLUSTER_SEND_INTERVAL));
+                    table.takeSharedEntries(entries);
+                    if (!entries.empty())
+                        sendMessage(fd, writeMutex, CLUSTER_ENTRIES, entries.data(), entries.size() * sizeof(HashEntry));
+                }
+            });
+        }
+        else if (type == CLUSTER_ENTRIES) {
+            const HashEntry *entries = (const HashEntry *) payload.data();
+            for (std::size_t i = 0; i < payload.size() / sizeof(HashEntry); i++)
+                table.addSharedEntry(entries[i]);
+            entriesReceived += payload.size() / sizeof(HashEntry);
+        }
+        else if (type == CLUSTER_STOP && payload.size() == sizeof(uint32_t)) {
+            uint32_t stopID;
+            std::memcpy(&stopID, payload.data(), sizeof(stopID));
+            if (stopID != currentID || !searchThread.joinable())
+                continue;
+            finishSearch();
+
+            const SearchResult &searchResult = search.getResult();
+            ClusterResult result;
+            result.searchID = currentID;
+            result.bestMove = searchResult.bestMove;
+            result.ponder = searchResult.ponder;
+            result.score = searchResult.score;
+            result.depth = searchResult.depth;
+            result.nodes = searchResult.nodes;
+            sendMessage(fd, writeMutex, CLUSTER_RESULT, &result, sizeof(result));
+        }
+    }
+
+    finishSearch();
+    ::close(fd);
+    cerr << "Searches : " << searches << endl;
+    cerr << "Received : " << entriesReceived << " entries" << endl;
+}
+
+static bool sendMessage(int fd, std::mutex &writeMutex, uint32_t type, const void *data, uint32_t length) {
+    ClusterMessageHeader header;
+    header.type = type;
+    header.length = length;
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return writeFully(fd, &header, sizeof(header)) && writeFully(fd, data, length);
+}
+
+static bool receiveMessage(int fd, uint32_t &type, std::vector<char> &payload) {
+    ClusterMessageHeader header;
+    if (!readFully(fd, &header, sizeof(header)))
+        return false;
+    type = header.type;
+    payload.resize(header.length);
+    return readFully(fd, payload.data(), header.length);
+}
+
+static bool writeFully(int fd, const void *buffer, std::size_t length) {
+    const char *data = (const char *) buffer;
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool readFully(int fd, void *buffer, std::size_t length) {
+    char *data = (char *) buffer;
+    while (length > 0) {
+        ssize_t received = read(fd, data, length);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
+static bool initSocketAddress(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << path << endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CLUSTER_H__
+#define __CLUSTER_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "analysis.h"
+#include "hash.h"
+#include "search.h"
+
+// Hash entries of at least this depth are shared between processes
+constexpr int CLUSTER_SHARE_DEPTH = 8;
+// Milliseconds between two batches of shared entries
+constexpr int CLUSTER_SEND_INTERVAL = 20;
+// Milliseconds to wait for the helpers' results after a depth or node-limited
+// search. Timed searches wait only for what is left of their time limit, but
+// at least CLUSTER_MIN_RESULT_TIMEOUT.
+constexpr int CLUSTER_RESULT_TIMEOUT = 2000;
+constexpr int CLUSTER_MIN_RESULT_TIMEOUT = 5;
+
+struct ClusterPeer;
+
+/**
+ * @brief The coordinating side of a cluster search. Helper processes started
+ * with "laser cluster <socket>" connect to the socket, and every search of
+ * the coordinator is run by all of them at once in the style of Lazy SMP:
+ * each process searches the same root, deep hash entries are exchanged in
+ * batches through the coordinator, and the root results are combined into
+ * one best move when the coordinator's search ends.
+ */
+class Cluster {
+public:
+    Cluster();
+    Cluster(const Cluster &other) = delete;
+    Cluster& operator=(const Cluster &other) = delete;
+    ~Cluster();
+
+    bool open(const std::string &path, Hash *table);
+    void close();
+    bool isOpen() const { return listener != -1; }
+    int getNumHelpers();
+
+    void search(Search &search, const Board *b, TimeManagement *timeParams, SearchResult &combined);
+
+private:
+    int listener;
+    std::string socketPath;
+    Hash *transpositionTable;
+    std::thread acceptThread;
+    // Guards the peer list and the peers' results
+    std::mutex peerMutex;
+    std::condition_variable resultReceived;
+    std::vector<ClusterPeer *> peers;
+    uint32_t searchID;
+
+    void acceptHelpers();
+    void receiveFromHelper(ClusterPeer *peer);
+    void sendToHelpers(uint32_t type, const void *data, uint32_t length, const ClusterPeer *except = nullptr);
+};
+
+void runClusterHelper(const AnalysisOptions &options);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "analysis.h"
+#include "datagen.h"
+#include "eval.h"
+#include "match.h"
+#include "packedpos.h"
+#include "search.h"
+#include "uci.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+ * @brief Work shared by all datagen workers. Game numbers are handed out
+ * through an atomic index; every finished game's positions are written to
+ * the output file at once under the lock.
+ */
+struct DatagenJob {
+    const DatagenOptions *options;
+    std::atomic<unsigned int> nextGame;
+    ChessTime startTime;
+
+    std::mutex outputMutex;
+    std::ofstream outputFile;
+    unsigned int finished;
+    int whiteWins, draws, blackWins;
+    uint64_t positions;
+    std::atomic<uint64_t> nodes;
+
+    DatagenJob() : options(nullptr), nextGame(0), finished(0),
+        whiteWins(0), draws(0), blackWins(0), positions(0), nodes(0) {}
+};
+
+static void datagenWorker(DatagenJob *job, uint64_t seed);
+static bool playOpening(std::mt19937_64 &rng, int plies, Board &board, TwoFoldStack &history);
+static uint8_t playGame(DatagenJob *job, Search *search, Board &board, TwoFoldStack &history,
+    std::vector<PackedPosition> &records);
+
+
+DatagenOptions::DatagenOptions() {
+    limit.searchMode = DEPTH;
+    limit.allotment = 8;
+    limit.maxAllotment = 0;
+    games = 1000;
+    workers = std::max(1, (int) std::thread::hardware_concurrency());
+    hashMB = 16;
+    randomPlies = 8;
+    seed = std::random_device()();
+}
+
+bool parseDatagenOptions(int argc, char **argv, DatagenOptions &options) {
+    if (argc < 1) {
+        cerr << "Usage: laser datagen <output> [depth <n> | nodes <n>] [games <n>] [workers <n>] "
+             << "[hash <MB>] [random <plies>] [seed <n>]" << endl;
+        return false;
+    }
+    options.outputFile = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        uint64_t value = 0;
+        if (i + 1 >= argc || !parseNumber(argv[i+1], value)) {
+            cerr << "Invalid datagen option: " << argv[i] << endl;
+            return false;
+        }
+        const char *name = argv[i];
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        i++;
+
+        if (strcmp(name, "depth") == 0) {
+            options.limit.searchMode = DEPTH;
+            options.limit.allotment = std::max(1, std::min(MAX_DEPTH, intValue));
+        }
+        else if (strcmp(name, "nodes") == 0) {
+            options.limit.searchMode = NODES;
+            options.limit.allotment = std::max(1, intValue);
+        }
+        else if (strcmp(name, "games") == 0)
+            options.games = intValue;
+        else if (strcmp(name, "workers") == 0)
+            options.workers = std::max(1, intValue);
+        else if (strcmp(name, "hash") == 0)
+            options.hashMB = std::max(MIN_HASH_SIZE, std::min(MAX_HASH_SIZE, value));
+        else if (strcmp(name, "random") == 0)
+            options.randomPlies = std::min(intValue, MATCH_MAX_PLIES);
+        else if (strcmp(name, "seed") == 0)
+            options.seed = value;
+        else {
+            cerr << "Invalid datagen option: " << name << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Generates the games with one single-threaded search per worker, so that
+ * all cores are busy without any Lazy SMP overhead. Progress and a summary
+ * go to stderr.
+ */
+void runDatagen(const DatagenOptions &options) {
+    DatagenJob job;
+    job.options = &options;
+    job.outputFile.open(options.outputFile, std::ios::binary | std::ios::app);
+    if (!job.outputFile) {
+        cerr << "Could not open " << options.outputFile << endl;
+        return;
+    }
+
+    job.startTime = ChessClock::now();
+
+    int workers = std::max(1, std::min(options.workers, (int) options.games));
+    std::vector<std::thread> workerThreads;
+    for (int i = 0; i < workers; i++)
+        workerThreads.push_back(std::thread(datagenWorker, &job, options.seed + i));
+    for (int i = 0; i < workers; i++)
+        workerThreads[i].join();
+
+    uint64_t time = std::max((uint64_t) 1, getTimeElapsed(job.startTime));
+    cerr << std::fixed << std::setprecision(1);
+    cerr << "Games     : " << job.finished << endl;
+    cerr << "Results   : " << job.whiteWins << " - " << job.blackWins << " - " << job.draws << endl;
+    cerr << "Positions : " << job.positions << endl;
+    cerr << "Seed      : " << options.seed << endl;
+    cerr << "Time      : " << time << " ms" << endl;
+    cerr << "Nodes     : " << job.nodes << endl;
+    cerr << "NPS       : " << 1000 * job.nodes / time << endl;
+    cerr << "Pos/hour  : " << 3600000.0 * job.positions / time << endl;
+}
+
+
+static void datagenWorker(DatagenJob *job, uint64_t seed) {
+    const DatagenOptions &options = *job->options;
+    Search *search = new Search();
+    search->setSilent(true);
+    search->setNumThreads(1);
+    search->setHashSize(options.hashMB);
+
+    std::mt19937_64 rng(seed);
+    std::vector<PackedPosition> records;
+
+    unsigned int g = job->nextGame++;
+    while (g < options.games) {
+        Board board;
+        TwoFoldStack history;
+        records.clear();
+        // Unusable openings are replaced by new ones for the same game
+        if (!playOpening(rng, options.randomPlies + (g & 1), board, history))
+            continue;
+
+        search->clearTables();
+        uint8_t result = playGame(job, search, board, history, records);
+        if (result == PACKED_NO_RESULT)
+            continue;
+        for (PackedPosition &p : records)
+            p.result = result;
+
+        std::lock_guard<std::mutex> lock(job->outputMutex);
+        job->outputFile.write(reinterpret_cast<const char *>(records.data()),
+            records.size() * sizeof(PackedPosition));
+        job->positions += records.size();
+        job->finished++;
+        if (result == PACKED_WHITE_WIN)
+            job->whiteWins++;
+        else if (result == PACKED_BLACK_WIN)
+            job->blackWins++;
+        else
+            job->draws++;
+
+        if (job->finished % DATAGEN_REPORT_INTERVAL == 0) {
+            uint64_t time = std::max((uint64_t) 1, getTimeElapsed(job->startTime));
+            cerr << "Games " << job->finished << ", positions " << job->positions
+                 << ", positions/hour " << (uint64_t) (3600000.0 * job->positions / time) << endl;
+        }
+        g = job->nextGame++;
+    }
+
+    delete search;
+}
+
+// Plays uniformly random legal moves from the starting position. Fails if
+// the game ends during the random moves.
+static bool playOpening(std::mt19937_64 &rng, int plies, Board &board, TwoFoldStack &history) {
+    for (int ply = 0; ply < plies; ply++) {
+        const int color = board.getPlayerToMove();
+        MoveList legalMoves = board.getAllLegalMoves(color);
+        if (legalMoves.size() == 0)
+            return false;
+        Move m = legalMoves.get(rng() % legalMoves.size());
+        pushHistory(history, board, m);
+        board.doMove(m, color);
+    }
+    return true;
+}
+
+// Plays out a game in self-play, collecting the quiet positions with their
+// scores. Returns the result from White's point of view, or PACKED_NO_RESULT
+// if the opening is too unbalanced to be used.
+static uint8_t playGame(DatagenJob *job, Search *search, Board &board, TwoFoldStack &history,
+        std::vector<PackedPosition> &records) {
+    const DatagenOptions &options = *job->options;
+    GameOutcome outcome = playAdjudicatedGame(board, history, search, search, options.limit, options.limit,
+        [job, &records](const Board &position, const SearchResult &result, int ply, int score) {
+            job->nodes += result.nodes;
+            if (ply == 0 && std::abs(score) > DATAGEN_MAX_OPENING_SCORE)
+                return false;
+            // Only quiet positions are recorded, where the score is not
+            // decided by an ongoing exchange or a pending promotion
+            Move m = result.bestMove;
+            if (!position.isInCheck(position.getPlayerToMove()) && !isCapture(m) && !isPromotion(m)
+             && std::abs(score) < DATAGEN_MAX_SCORE)
+                records.push_back(packPosition(position, (int16_t) score));
+            return true;
+        });
+
+    if (outcome.termination.empty())
+        return PACKED_NO_RESULT;
+    return (outcome.winner == WHITE) ? PACKED_WHITE_WIN
+         : (outcome.winner == BLACK) ? PACKED_BLACK_WIN : PACKED_DRAW;
+}
@@ -0,0 +1,59 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DATAGEN_H__
+#define __DATAGEN_H__
+
+#include <cstdint>
+#include <string>
+#include "timeman.h"
+
+// Openings whose first search is further from equal than this many
+// centipawns are discarded
+constexpr int DATAGEN_MAX_OPENING_SCORE = 400;
+// Positions scored at or beyond this many centipawns are not recorded
+constexpr int DATAGEN_MAX_SCORE = 3000;
+// Finished games between two progress lines
+constexpr unsigned int DATAGEN_REPORT_INTERVAL = 100;
+
+/**
+ * @brief Settings for training-data generation from the command line:
+ *   laser datagen <output> [depth <n> | nodes <n>] [games <n>] [workers <n>]
+ *       [hash <MB>] [random <plies>] [seed <n>]
+ * Every game starts with random plies (plus one on every other game, so that
+ * both sides get to move first) of uniformly random legal moves and is then
+ * played out in self-play with the given limit. Quiet positions are appended
+ * to the output file as packed positions with their search score and the
+ * game result.
+ */
+struct DatagenOptions {
+    std::string outputFile;
+    TimeManagement limit;
+    unsigned int games;
+    int workers;
+    uint64_t hashMB;
+    int randomPlies;
+    uint64_t seed;
+
+    DatagenOptions();
+};
+
+bool parseDatagenOptions(int argc, char **argv, DatagenOptions &options);
+void runDatagen(const DatagenOptions &options);
+
+#endif
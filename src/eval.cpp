@@ -24,6 +24,7 @@
 #include "board.h"
 #include "common.h"
 #include "eval.h"
+#include "instrument.h"
 #include "uci.h"
 
 namespace {
@@ -199,6 +200,7 @@ void setKingSafetyScale(int s) {
  */
 template <bool debug>
 int Eval::evaluate(Board &b) {
+    INSTRUMENT_SCOPE(IC_EVALUATE);
     int material[2][2] = {{0, 0}, {0, 0}};
     int egFactorMaterial = 0;
     // Copy necessary values from Board and precompute the number of each piece on the board as well as material totals
@@ -18,8 +18,9 @@
 
 #include <cstring>
 #include "hash.h"
+#include "instrument.h"
 
-Hash::Hash(uint64_t MB) {
+Hash::Hash(uint64_t MB) : shareDepth(MAX_DEPTH + 1) {
     init(MB);
 }
 
@@ -30,44 +31,84 @@ Hash::~Hash() {
 // Adds key and move into the hashtable. This function assumes that the key has
 // been checked with get and is not in the table.
 void Hash::add(Board &b, int score, Move move, int eval, int depth, uint8_t nodeType) {
-    uint64_t h = b.getZobristKey();
-    uint64_t index = h & (size-1);
+    INSTRUMENT_SCOPE(IC_TT_STORE);
+    store(b.getZobristKey(), score, move, eval, depth, nodeType);
+
+    if (depth >= shareDepth.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (sharedEntries.size() < MAX_SHARED_ENTRIES) {
+            HashEntry entry;
+            entry.setEntry(b.getZobristKey(), score, move, eval, depth, nodeType, 0);
+            sharedEntries.push_back(entry);
+        }
+    }
+}
+
+void Hash::store(uint64_t key, int score, Move move, int eval, int depth, uint8_t nodeType) {
+    uint64_t index = key & (size-1);
     HashNode *node = table + index;
+    const uint8_t currentAge = age.load(std::memory_order_relaxed);
 
     // Decide whether to replace the entry
     // A more recent update to the same position should always be chosen
-    if (node->slot1.zobristKey == b.getZobristKey())
-        node->slot1.setEntry(b, score, move, eval, depth, nodeType, age);
+    if (node->slot1.zobristKey == key)
+        node->slot1.setEntry(key, score, move, eval, depth, nodeType, currentAge);
 
-    else if (node->slot2.zobristKey == b.getZobristKey())
-        node->slot2.setEntry(b, score, move, eval, depth, nodeType, age);
+    else if (node->slot2.zobristKey == key)
+        node->slot2.setEntry(key, score, move, eval, depth, nodeType, currentAge);
 
     // Replace an entry from a previous search space, or the lowest depth
     // entry with the new entry if the new entry's depth is high enough
     else {
         HashEntry *toReplace = &(node->slot1);
-        int score1 = 16 * ((int) ((uint8_t) (age - (node->slot1.ageNodeType >> 2))))
+        int score1 = 16 * ((int) ((uint8_t) (currentAge - (node->slot1.ageNodeType >> 2))))
             + depth - node->slot1.depth;
-        int score2 = 16 * ((int) ((uint8_t) (age - (node->slot2.ageNodeType >> 2))))
+        int score2 = 16 * ((int) ((uint8_t) (currentAge - (node->slot2.ageNodeType >> 2))))
             + depth - node->slot2.depth;
         if (score1 < score2)
             toReplace = &(node->slot2);
         // The node must be from a newer search space or a sufficiently high depth
         if (score1 >= -2 || score2 >= -2)
-            toReplace->setEntry(b, score, move, eval, depth, nodeType, age);
+            toReplace->setEntry(key, score, move, eval, depth, nodeType, currentAge);
     }
 }
 
+void Hash::setShareDepth(int depth) {
+    shareDepth.store(depth, std::memory_order_relaxed);
+}
+
+// Moves the entries queued for other processes into entries
+void Hash::takeSharedEntries(std::vector<HashEntry> &entries) {
+    entries.clear();
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    entries.swap(sharedEntries);
+}
+
+// Adds an entry received from another process, without queueing it again
+void Hash::addSharedEntry(const HashEntry &entry) {
+    HashNode *node = table + (entry.zobristKey & (size-1));
+    // Keep our own result for the position unless the shared one is deeper
+    if ((node->slot1.zobristKey == entry.zobristKey && node->slot1.depth >= entry.depth)
+     || (node->slot2.zobristKey == entry.zobristKey && node->slot2.depth >= entry.depth))
+        return;
+    store(entry.zobristKey, entry.score, entry.move, entry.eval, entry.depth, entry.ageNodeType & 3);
+}
+
 // Get the hash entry, if any, associated with a board b.
 HashEntry *Hash::get(Board &b) {
+    INSTRUMENT_SCOPE(IC_TT_PROBE);
     uint64_t h = b.getZobristKey();
     uint64_t index = h & (size-1);
     HashNode *node = table + index;
 
-    if (node->slot1.zobristKey == b.getZobristKey())
+    if (node->slot1.zobristKey == b.getZobristKey()) {
+        INSTRUMENT_COUNT(IC_TT_HIT);
         return &(node->slot1);
-    else if (node->slot2.zobristKey == b.getZobristKey())
+    }
+    else if (node->slot2.zobristKey == b.getZobristKey()) {
+        INSTRUMENT_COUNT(IC_TT_HIT);
         return &(node->slot2);
+    }
 
     return nullptr;
 }
@@ -97,20 +138,21 @@ void Hash::init(uint64_t MB) {
 }
 
 void Hash::incrementAge() {
-    age++;
+    age.fetch_add(1, std::memory_order_relaxed);
 }
 
 void Hash::clear() {
     std::memset(static_cast<void*>(table), 0, size * sizeof(HashNode));
-    age = 0;
+    age.store(0, std::memory_order_relaxed);
 }
 
 int Hash::estimateHashfull() const {
     int used = 0;
+    const uint8_t currentAge = age.load(std::memory_order_relaxed);
     // This will never go out of bounds since a 1 MB table has 32768 slots
     for (int i = 0; i < 500; i++) {
-        used += ((table + i)->slot1.ageNodeType >> 2) == age;
-        used += ((table + i)->slot2.ageNodeType >> 2) == age;
+        used += ((table + i)->slot1.ageNodeType >> 2) == currentAge;
+        used += ((table + i)->slot2.ageNodeType >> 2) == currentAge;
     }
     return used;
 }
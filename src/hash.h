@@ -19,6 +19,9 @@
 #ifndef __HASH_H__
 #define __HASH_H__
 
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "board.h"
 #include "common.h"
 
@@ -41,8 +44,8 @@ struct HashEntry {
     HashEntry() = default;
     ~HashEntry() = default;
 
-    void setEntry(Board &b, int _score, Move _move, int _eval, int _depth, uint8_t _nodeType, uint8_t _age) {
-        zobristKey = b.getZobristKey();
+    void setEntry(uint64_t key, int _score, Move _move, int _eval, int _depth, uint8_t _nodeType, uint8_t _age) {
+        zobristKey = key;
         score = (int16_t) _score;
         move = _move;
         eval = (int16_t) _eval;
@@ -61,13 +64,27 @@ public:
     ~HashNode() {}
 };
 
+// Most entries queued for other cluster processes between two sends; newer
+// entries are dropped while the queue is full
+constexpr unsigned int MAX_SHARED_ENTRIES = 4096;
+
 class Hash {
 private:
     HashNode *table;
     uint64_t size;
-    uint8_t age;
+    // Advanced by the owner of the table once per search or job. Sessions of
+    // the server may advance a shared table while others search.
+    std::atomic<uint8_t> age;
+
+    // New entries of at least this depth are also queued to be sent to other
+    // processes of a cluster search. Sharing is off by default. It may be
+    // changed while other threads search.
+    std::atomic<int> shareDepth;
+    std::mutex sharedMutex;
+    std::vector<HashEntry> sharedEntries;
 
     void init(uint64_t MB);
+    void store(uint64_t key, int score, Move move, int eval, int depth, uint8_t nodeType);
 
 public:
     Hash(uint64_t MB);
@@ -77,6 +94,13 @@ public:
 
     void add(Board &b, int score, Move move, int eval, int depth, uint8_t nodeType);
     HashEntry *get(Board &b);
+    // Starts loading the bucket of a key into the cache, ahead of get or add
+    void prefetch(uint64_t key) const { __builtin_prefetch(table + (key & (size-1))); }
+
+    // Sharing entries with other processes of a cluster search
+    void setShareDepth(int depth);
+    void takeSharedEntries(std::vector<HashEntry> &entries);
+    void addSharedEntry(const HashEntry &entry);
 
     uint64_t getSize() const;
     void setSize(uint64_t MB);
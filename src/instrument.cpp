@@ -0,0 +1,129 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "instrument.h"
+#include "output.h"
+
+#if defined(INSTRUMENT) || defined(INSTRUMENT_TIMERS)
+
+static const char *COUNTER_NAMES[NUM_INSTRUMENT_COUNTERS] = {
+    "pvs", "quiescence", "checkquiescence", "evaluate",
+    "gencaptures", "genquiets", "genpromotions", "genchecks", "genevasions",
+    "scorecaptures", "scorequiets", "see",
+    "ttprobe", "tthit", "ttstore"
+};
+
+thread_local ThreadInstrumentStats threadInstrumentStats;
+
+// The counters of running threads, and the totals of threads that have exited
+static std::mutex statsMutex;
+static std::vector<ThreadInstrumentStats *> liveStats;
+static InstrumentStats retiredStats;
+
+static void addStats(InstrumentStats &total, const InstrumentStats &other);
+
+
+ThreadInstrumentStats::ThreadInstrumentStats() : current(-1), lastCycles(0) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    liveStats.push_back(this);
+}
+
+ThreadInstrumentStats::~ThreadInstrumentStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    addStats(retiredStats, stats);
+    liveStats.erase(std::find(liveStats.begin(), liveStats.end(), this));
+}
+
+#ifdef INSTRUMENT_TIMERS
+uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+#endif
+
+/*
+ * Prints the counters of all threads so far as info strings, one line per
+ * counter. With timers, each line also has the cycles charged to the
+ * counter, the cycles per call, and the share of all instrumented cycles.
+ * Counters of threads that are still searching are read while they change,
+ * so this is meant for when no search is running.
+ */
+void printInstrumentStats() {
+    InstrumentStats total;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        addStats(total, retiredStats);
+        for (unsigned int i = 0; i < liveStats.size(); i++)
+            addStats(total, liveStats[i]->stats);
+    }
+
+#ifdef INSTRUMENT_TIMERS
+    uint64_t totalCycles = 0;
+    for (int i = 0; i < NUM_INSTRUMENT_COUNTERS; i++)
+        totalCycles += total.cycles[i];
+#endif
+
+    for (int i = 0; i < NUM_INSTRUMENT_COUNTERS; i++) {
+        OutputLine line;
+        line << "info string instrument " << COUNTER_NAMES[i] << " calls " << total.calls[i];
+#ifdef INSTRUMENT_TIMERS
+        if (total.cycles[i]) {
+            line << " cycles " << total.cycles[i]
+                 << " percall " << total.cycles[i] / std::max((uint64_t) 1, total.calls[i])
+                 << " share " << std::fixed << std::setprecision(1)
+                 << 100.0 * total.cycles[i] / totalCycles << "%";
+        }
+#endif
+    }
+}
+
+void resetInstrumentStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    retiredStats.reset();
+    for (unsigned int i = 0; i < liveStats.size(); i++)
+        liveStats[i]->stats.reset();
+}
+
+static void addStats(InstrumentStats &total, const InstrumentStats &other) {
+    for (int i = 0; i < NUM_INSTRUMENT_COUNTERS; i++) {
+        total.calls[i] += other.calls[i];
+        total.cycles[i] += other.cycles[i];
+    }
+}
+
+#else
+
+void printInstrumentStats() {
+    OutputLine() << "info string instrumentation is not enabled in this build";
+}
+
+void resetInstrumentStats() {}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+#include <cstdint>
+
+/*
+ * Counters and cycle timers for the hot paths of the search, for builds made
+ * with INSTRUMENT=true (calls only) or INSTRUMENT_TIMERS=true (calls and
+ * cycles). In other builds the macros expand to nothing.
+ *
+ * INSTRUMENT_SCOPE counts a call and, with timers, charges the cycles until
+ * the end of the enclosing block to the counter. Cycles spent in a nested
+ * scope are charged to the nested counter only, so the cycles of all
+ * counters add up to the time spent inside instrumented code, and recursive
+ * functions such as PVS are not counted more than once.
+ * INSTRUMENT_COUNT only counts an event.
+ *
+ * Each thread keeps its own counters, which are added to the totals when
+ * the thread exits.
+ */
+
+enum InstrumentCounter {
+    IC_PVS, IC_QUIESCENCE, IC_CHECK_QUIESCENCE, IC_EVALUATE,
+    IC_GEN_CAPTURES, IC_GEN_QUIETS, IC_GEN_PROMOTIONS, IC_GEN_CHECKS, IC_GEN_EVASIONS,
+    IC_SCORE_CAPTURES, IC_SCORE_QUIETS, IC_SEE,
+    IC_TT_PROBE, IC_TT_HIT, IC_TT_STORE,
+    NUM_INSTRUMENT_COUNTERS
+};
+
+struct InstrumentStats {
+    uint64_t calls[NUM_INSTRUMENT_COUNTERS];
+    uint64_t cycles[NUM_INSTRUMENT_COUNTERS];
+
+    InstrumentStats() {
+        reset();
+    }
+
+    void reset() {
+        for (int i = 0; i < NUM_INSTRUMENT_COUNTERS; i++) {
+            calls[i] = 0;
+            cycles[i] = 0;
+        }
+    }
+};
+
+void printInstrumentStats();
+void resetInstrumentStats();
+
+#if defined(INSTRUMENT) || defined(INSTRUMENT_TIMERS)
+
+/**
+ * @brief The counters of one thread, and the scope its time is currently
+ * charged to
+ */
+struct ThreadInstrumentStats {
+    InstrumentStats stats;
+    // The innermost open scope, or -1 outside all scopes
+    int current;
+    uint64_t lastCycles;
+
+    ThreadInstrumentStats();
+    ~ThreadInstrumentStats();
+};
+
+extern thread_local ThreadInstrumentStats threadInstrumentStats;
+
+#ifdef INSTRUMENT_TIMERS
+uint64_t readCycleCounter();
+
+class InstrumentScope {
+public:
+    InstrumentScope(int counter) {
+        ThreadInstrumentStats &t = threadInstrumentStats;
+        uint64_t now = readCycleCounter();
+        if (t.current >= 0)
+            t.stats.cycles[t.current] += now - t.lastCycles;
+        previous = t.current;
+        t.current = counter;
+        t.lastCycles = now;
+        t.stats.calls[counter]++;
+    }
+    InstrumentScope(const InstrumentScope &other) = delete;
+    InstrumentScope& operator=(const InstrumentScope &other) = delete;
+    ~InstrumentScope() {
+        ThreadInstrumentStats &t = threadInstrumentStats;
+        uint64_t now = readCycleCounter();
+        t.stats.cycles[t.current] += now - t.lastCycles;
+        t.current = previous;
+        t.lastCycles = now;
+    }
+
+private:
+    int previous;
+};
+
+#define INSTRUMENT_SCOPE(counter) InstrumentScope instrumentScope(counter)
+#else
+#define INSTRUMENT_SCOPE(counter) (threadInstrumentStats.stats.calls[counter]++)
+#endif
+
+#define INSTRUMENT_COUNT(counter) (threadInstrumentStats.stats.calls[counter]++)
+
+#else
+
+#define INSTRUMENT_SCOPE(counter) ((void) 0)
+#define INSTRUMENT_COUNT(counter) ((void) 0)
+
+#endif
+
+#endif
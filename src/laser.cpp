@@ -0,0 +1,210 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include "bbinit.h"
+#include "board.h"
+#include "eval.h"
+#include "laser.h"
+#include "notation.h"
+#include "search.h"
+#include "timeman.h"
+#include "uci.h"
+
+static_assert(LASER_MAX_PV == MAX_DEPTH + 1, "LASER_MAX_PV must hold a full PV");
+static_assert(LASER_MAX_FEN >= MAX_FEN_LENGTH, "LASER_MAX_FEN must hold any FEN");
+
+struct LaserEngine {
+    Board board;
+    Search search;
+};
+
+static std::once_flag initFlag;
+
+void initTables();
+int clampInt(int value, int low, int high);
+void fillSearchInfo(const SearchResult &result, LaserSearchInfo *info);
+
+
+// The tables shared by all engines are set up once, by the first engine
+void initTables() {
+    initMagicTables(2563762638929852183ULL);
+    initEvalTables();
+    initDistances();
+    initZobristTable();
+    initInBetweenTable();
+    initReductionTable();
+}
+
+LaserEngine *laser_create(int hash_mb, int threads) {
+    std::call_once(initFlag, initTables);
+
+    LaserEngine *engine = new (std::nothrow) LaserEngine;
+    if (engine == nullptr)
+        return nullptr;
+    engine->search.setSilent(true);
+    laser_set_hash_size(engine, hash_mb);
+    laser_set_threads(engine, threads);
+    return engine;
+}
+
+void laser_destroy(LaserEngine *engine) {
+    delete engine;
+}
+
+void laser_set_hash_size(LaserEngine *engine, int hash_mb) {
+    engine->search.setHashSize((uint64_t) clampInt(hash_mb, (int) MIN_HASH_SIZE, (int) MAX_HASH_SIZE));
+}
+
+void laser_set_threads(LaserEngine *engine, int threads) {
+    engine->search.setNumThreads(clampInt(threads, MIN_THREADS, MAX_THREADS));
+}
+
+void laser_new_game(LaserEngine *engine) {
+    engine->search.clearTables();
+}
+
+int laser_set_position(LaserEngine *engine, const char *fen, const char *moves) {
+    Board board;
+    if (fen != nullptr && !parseFEN(StringView(fen), board))
+        return LASER_INVALID_FEN;
+
+    TwoFoldStack twoFoldPositions;
+    if (!playMoves((moves != nullptr) ? StringView(moves) : StringView(), board, &twoFoldPositions))
+        return LASER_ILLEGAL_MOVE;
+
+    engine->board = board;
+    *engine->search.getTwoFoldStackPointer() = twoFoldPositions;
+    return LASER_OK;
+}
+
+int laser_get_fen(const LaserEngine *engine, char *buffer, size_t size) {
+    char fen[MAX_FEN_LENGTH];
+    int length = writeFEN(engine->board, fen);
+    if ((size_t) length >= size)
+        return LASER_BUFFER_TOO_SMALL;
+    std::memcpy(buffer, fen, length + 1);
+    return LASER_OK;
+}
+
+int laser_search(LaserEngine *engine, const LaserLimits *limits, LaserInfoCallback callback,
+        void *user_data, LaserSearchInfo *result) {
+    TimeManagement timeParams;
+    timeParams.maxAllotment = 0;
+    if (limits != nullptr && limits->depth > 0) {
+        timeParams.searchMode = DEPTH;
+        timeParams.allotment = std::min(limits->depth, MAX_DEPTH);
+    }
+    else if (limits != nullptr && limits->nodes > 0) {
+        timeParams.searchMode = NODES;
+        timeParams.allotment = (int) std::min(limits->nodes, (uint64_t) INT_MAX);
+    }
+    else if (limits != nullptr && limits->movetime > 0) {
+        timeParams.searchMode = MOVETIME;
+        timeParams.allotment = (int) std::min(limits->movetime, (uint64_t) INT_MAX);
+    }
+    else {
+        timeParams.searchMode = DEPTH;
+        timeParams.allotment = MAX_DEPTH;
+    }
+
+    if (callback != nullptr) {
+        engine->search.setIterationCallback([callback, user_data](const SearchResult &progress) {
+            LaserSearchInfo info;
+            fillSearchInfo(progress, &info);
+            callback(&info, user_data);
+        });
+    }
+    else
+        engine->search.setIterationCallback(nullptr);
+
+    MoveList movesToSearch;
+    engine->search.isStop = false;
+    engine->search.stopSignal = false;
+    engine->search.getBestMoveThreader(&engine->board, &timeParams, &movesToSearch);
+    engine->search.setIterationCallback(nullptr);
+
+    if (result != nullptr)
+        fillSearchInfo(engine->search.getResult(), result);
+    return LASER_OK;
+}
+
+void laser_stop(LaserEngine *engine) {
+    engine->search.isStop = true;
+    engine->search.stopSignal = true;
+}
+
+int laser_evaluate(const LaserEngine *engine) {
+    Board board = engine->board.staticCopy();
+    Eval e;
+    int score = e.evaluate(board);
+    if (board.getPlayerToMove() == BLACK)
+        score = -score;
+    return score * 100 / PIECE_VALUES[EG][PAWNS];
+}
+
+int laser_legal_moves(const LaserEngine *engine, LaserMove *moves, int max_moves) {
+    MoveList legalMoves = engine->board.getAllLegalMoves(engine->board.getPlayerToMove());
+    for (int i = 0; i < std::min((int) legalMoves.size(), max_moves); i++)
+        moves[i] = legalMoves.get(i);
+    return (int) legalMoves.size();
+}
+
+uint64_t laser_perft(const LaserEngine *engine, int depth) {
+    Board board = engine->board.staticCopy();
+    uint64_t captures = 0;
+    return perft(board, board.getPlayerToMove(), depth, captures);
+}
+
+void laser_move_to_uci(LaserMove move, char *buffer) {
+    std::string moveStr = moveToString(move);
+    std::memcpy(buffer, moveStr.c_str(), std::min(moveStr.length() + 1, (size_t) 6));
+    buffer[5] = '\0';
+}
+
+int clampInt(int value, int low, int high) {
+    return std::max(low, std::min(value, high));
+}
+
+// Converts a result from internal units to the form used by the C interface
+void fillSearchInfo(const SearchResult &result, LaserSearchInfo *info) {
+    info->depth = result.depth;
+    if (result.score >= MAX_PLY_MATE_SCORE) {
+        info->score = (MATE_SCORE - result.score) / 2 + 1;
+        info->is_mate = 1;
+    }
+    else if (result.score <= -MAX_PLY_MATE_SCORE) {
+        info->score = (-MATE_SCORE - result.score) / 2;
+        info->is_mate = 1;
+    }
+    else {
+        info->score = result.score * 100 / PIECE_VALUES[EG][PAWNS];
+        info->is_mate = 0;
+    }
+    info->nodes = result.nodes;
+    info->time = result.time;
+    info->best_move = result.bestMove;
+    info->ponder_move = result.ponder;
+    info->pv_length = result.pv.pvLength;
+    for (int i = 0; i < result.pv.pvLength; i++)
+        info->pv[i] = result.pv.pv[i];
+}
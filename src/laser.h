@@ -0,0 +1,130 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LASER_H__
+#define __LASER_H__
+
+/*
+ * C interface to the engine, built as liblaser.a and liblaser.so.
+ *
+ * Every engine instance has its own board, transposition table and search
+ * threads, so different instances may be used from different threads at the
+ * same time. Calls on one instance must not overlap, except for laser_stop(),
+ * which may be called from any thread while laser_search() is running.
+ * Nothing is written to stdout.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LASER_MAX_PV 128
+#define LASER_MAX_MOVES 256
+/* Buffer size for laser_get_fen() that always suffices */
+#define LASER_MAX_FEN 100
+
+/* Return codes */
+#define LASER_OK 0
+#define LASER_INVALID_FEN -1
+#define LASER_ILLEGAL_MOVE -2
+#define LASER_BUFFER_TOO_SMALL -3
+
+/*
+ * A move in the engine's 16-bit encoding. laser_move_to_uci() converts it to
+ * long algebraic notation.
+ */
+typedef uint16_t LaserMove;
+
+typedef struct LaserEngine LaserEngine;
+
+/*
+ * Limits of a search. The first nonzero field of depth, nodes and movetime is
+ * used; if all are zero, the search runs until laser_stop() is called.
+ */
+typedef struct {
+    int depth;
+    uint64_t nodes;
+    /* In milliseconds */
+    uint64_t movetime;
+} LaserLimits;
+
+typedef struct {
+    int depth;
+    /* Centipawns from the side to move, or moves to mate if is_mate is set
+       (negative if the side to move is getting mated) */
+    int score;
+    int is_mate;
+    uint64_t nodes;
+    /* In milliseconds */
+    uint64_t time;
+    LaserMove best_move;
+    /* 0 if there is none */
+    LaserMove ponder_move;
+    int pv_length;
+    LaserMove pv[LASER_MAX_PV];
+} LaserSearchInfo;
+
+/*
+ * Called after each completed iteration of a search. With more than one
+ * search thread, it runs on one of the engine's threads rather than the
+ * caller's.
+ */
+typedef void (*LaserInfoCallback)(const LaserSearchInfo *info, void *user_data);
+
+/* Creates an engine at the start position. Returns NULL on failure. */
+LaserEngine *laser_create(int hash_mb, int threads);
+void laser_destroy(LaserEngine *engine);
+
+void laser_set_hash_size(LaserEngine *engine, int hash_mb);
+void laser_set_threads(LaserEngine *engine, int threads);
+/* Clears the transposition table and search history */
+void laser_new_game(LaserEngine *engine);
+
+/*
+ * Sets the position from a FEN (the start position if NULL), followed by a
+ * space-separated list of moves in long algebraic notation (none if NULL).
+ * On error, the previous position is kept.
+ */
+int laser_set_position(LaserEngine *engine, const char *fen, const char *moves);
+int laser_get_fen(const LaserEngine *engine, char *buffer, size_t size);
+
+/*
+ * Searches the current position. Blocks until the search ends, and fills in
+ * result if it is not NULL. callback may be NULL.
+ */
+int laser_search(LaserEngine *engine, const LaserLimits *limits, LaserInfoCallback callback,
+    void *user_data, LaserSearchInfo *result);
+void laser_stop(LaserEngine *engine);
+
+/* Static evaluation in centipawns from the side to move */
+int laser_evaluate(const LaserEngine *engine);
+/* Writes up to max_moves legal moves and returns the number of legal moves */
+int laser_legal_moves(const LaserEngine *engine, LaserMove *moves, int max_moves);
+uint64_t laser_perft(const LaserEngine *engine, int depth);
+
+/* Writes the move in long algebraic notation; buffer must hold 6 characters */
+void laser_move_to_uci(LaserMove move, char *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,467 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "analysis.h"
+#include "annotate.h"
+#include "eval.h"
+#include "match.h"
+#include "notation.h"
+#include "output.h"
+#include "search.h"
+#include "uci.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+ * @brief A finished game: the opening it started from, the moves played,
+ * and how it ended. Results are from White's point of view.
+ */
+struct MatchGame {
+    unsigned int round;
+    Board start;
+    bool isEngineAWhite;
+    std::vector<Move> moves;
+    std::string result;
+    std::string termination;
+};
+
+/**
+ * @brief Work shared by all match workers. Games are handed out one at a
+ * time through an atomic index; results are gathered under a lock.
+ */
+struct MatchJob {
+    const MatchOptions *options;
+    std::vector<Board> openings;
+    unsigned int games;
+    std::atomic<unsigned int> nextGame;
+    // Set once the SPRT is decided, so that no further games are started
+    std::atomic<bool> isDecided;
+
+    std::mutex resultMutex;
+    std::ofstream pgnFile;
+    // Results from engine A's point of view
+    int wins, draws, losses;
+    std::atomic<uint64_t> nodes;
+
+    MatchJob() : options(nullptr), games(0), nextGame(0), isDecided(false),
+        wins(0), draws(0), losses(0), nodes(0) {}
+};
+
+static bool readOpenings(const std::string &fileName, std::vector<Board> &openings);
+static void matchWorker(MatchJob *job);
+static void playGame(MatchJob *job, Search *white, Search *black, const TimeManagement &whiteLimit,
+    const TimeManagement &blackLimit, MatchGame &game);
+static std::string gameToPGN(const MatchGame &game);
+static double getLLR(int wins, int draws, int losses, double elo0, double elo1);
+static double scoreToElo(double score);
+
+
+MatchOptions::MatchOptions() {
+    limit.searchMode = NODES;
+    limit.allotment = 10000;
+    limit.maxAllotment = 0;
+    odds = 100;
+    games = 0;
+    workers = 1;
+    threads = 1;
+    hashMB = 16;
+    useSPRT = false;
+    elo0 = 0;
+    elo1 = 5;
+}
+
+bool parseMatchOptions(int argc, char **argv, MatchOptions &options) {
+    if (argc < 1) {
+        cerr << "Usage: laser match <openings> [depth <n> | nodes <n> | movetime <ms>] [odds <percent>] "
+             << "[games <n>] [workers <n>] [threads <n>] [hash <MB>] [pgn <file>] [sprt <elo0> <elo1>]" << endl;
+        return false;
+    }
+    options.openingFile = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "pgn") == 0 && i + 1 < argc) {
+            options.pgnFile = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "sprt") == 0 && i + 2 < argc) {
+            options.useSPRT = true;
+            options.elo0 = atof(argv[i+1]);
+            options.elo1 = atof(argv[i+2]);
+            i += 2;
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (i + 1 >= argc || !parseNumber(argv[i+1], value)) {
+            cerr << "Invalid match option: " << argv[i] << endl;
+            return false;
+        }
+        const char *name = argv[i];
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        i++;
+
+        if (strcmp(name, "depth") == 0) {
+            options.limit.searchMode = DEPTH;
+            options.limit.allotment = std::min(MAX_DEPTH, intValue);
+        }
+        else if (strcmp(name, "nodes") == 0) {
+            options.limit.searchMode = NODES;
+            options.limit.allotment = intValue;
+        }
+        else if (strcmp(name, "movetime") == 0) {
+            options.limit.searchMode = MOVETIME;
+            options.limit.allotment = intValue;
+        }
+        else if (strcmp(name, "odds") == 0)
+            options.odds = std::max(1, intValue);
+        else if (strcmp(name, "games") == 0)
+            options.games = intValue;
+        else if (strcmp(name, "workers") == 0)
+            options.workers = std::max(1, intValue);
+        else if (strcmp(name, "threads") == 0)
+            options.threads = std::max(MIN_THREADS, std::min(MAX_THREADS, intValue));
+        else if (strcmp(name, "hash") == 0)
+            options.hashMB = std::max(MIN_HASH_SIZE, std::min(MAX_HASH_SIZE, value));
+        else {
+            cerr << "Invalid match option: " << name << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Plays the match and writes each game as PGN, to stdout or the given file,
+ * as soon as it is finished. A summary with the score, the Elo difference of
+ * engine A over engine B with its 95% error margin, and the SPRT state goes
+ * to stderr.
+ */
+void runMatch(const MatchOptions &options) {
+    MatchJob job;
+    job.options = &options;
+    if (!readOpenings(options.openingFile, job.openings))
+        return;
+    if (job.openings.empty()) {
+        cerr << "No openings in " << options.openingFile << endl;
+        return;
+    }
+    job.games = options.games ? options.games : 2 * job.openings.size();
+
+    if (!options.pgnFile.empty()) {
+        job.pgnFile.open(options.pgnFile);
+        if (!job.pgnFile) {
+            cerr << "Could not open " << options.pgnFile << endl;
+            return;
+        }
+    }
+
+    auto startTime = ChessClock::now();
+
+    int workers = std::max(1, std::min(options.workers, (int) job.games));
+    std::vector<std::thread> workerThreads;
+    for (int i = 0; i < workers; i++)
+        workerThreads.push_back(std::thread(matchWorker, &job));
+    for (int i = 0; i < workers; i++)
+        workerThreads[i].join();
+
+    uint64_t time = std::max((uint64_t) 1, getTimeElapsed(startTime));
+    int played = job.wins + job.draws + job.losses;
+    double score = played ? (job.wins + 0.5 * job.draws) / played : 0.5;
+
+    // Standard error of the mean score per game, which gives the margin of
+    // the Elo difference
+    double variance = 0;
+    if (played) {
+        variance = (job.wins * (1 - score) * (1 - score) + job.draws * (0.5 - score) * (0.5 - score)
+                  + job.losses * score * score) / played;
+    }
+    double margin = 1.959964 * std::sqrt(variance / std::max(played, 1));
+    double elo = scoreToElo(score);
+    double eloMargin = (scoreToElo(std::min(score + margin, 0.999)) - scoreToElo(std::max(score - margin, 0.001))) / 2;
+    double los = (job.wins + job.losses) ? 0.5 * (1 + std::erf((job.wins - job.losses)
+        / std::sqrt(2.0 * (job.wins + job.losses)))) : 0.5;
+
+    cerr << std::fixed << std::setprecision(1);
+    cerr << "Games     : " << played << endl;
+    cerr << "Score     : " << job.wins << " - " << job.losses << " - " << job.draws
+         << " [" << 100 * score << "%]" << endl;
+    cerr << "Elo       : " << std::showpos << elo << std::noshowpos << " +/- " << eloMargin << endl;
+    cerr << "LOS       : " << 100 * los << "%" << endl;
+    if (options.useSPRT) {
+        double llr = getLLR(job.wins, job.draws, job.losses, options.elo0, options.elo1);
+        double lower = std::log(SPRT_BETA / (1 - SPRT_ALPHA));
+        double upper = std::log((1 - SPRT_BETA) / SPRT_ALPHA);
+        cerr << std::setprecision(2);
+        cerr << "LLR       : " << llr << " (" << lower << ", " << upper << ") ["
+             << options.elo0 << ", " << options.elo1 << "] "
+             << ((llr >= upper) ? "H1 accepted" : (llr <= lower) ? "H0 accepted" : "undecided") << endl;
+    }
+    cerr << std::setprecision(1);
+    cerr << "Time      : " << time << " ms" << endl;
+    cerr << "Nodes     : " << job.nodes << endl;
+    cerr << "NPS       : " << 1000 * job.nodes / time << endl;
+    cerr << "Games/min : " << 60000.0 * played / time << endl;
+}
+
+
+// Reads the FEN or EPD lines of the opening file, skipping blank lines,
+// comments and invalid positions
+static bool readOpenings(const std::string &fileName, std::vector<Board> &openings) {
+    std::ifstream file(fileName);
+    if (!file) {
+        cerr << "Could not open " << fileName << endl;
+        return false;
+    }
+
+    std::string line;
+    for (unsigned int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        StringView first(line);
+        first = nextToken(first);
+        if (first.empty() || first[0] == '#')
+            continue;
+
+        Board board;
+        if (!parseFEN(StringView(line), board)) {
+            cerr << "Skipping invalid opening on line " << lineNumber << endl;
+            continue;
+        }
+        openings.push_back(board);
+    }
+    return true;
+}
+
+static void matchWorker(MatchJob *job) {
+    const MatchOptions &options = *job->options;
+    Search *engineA = new Search();
+    Search *engineB = new Search();
+    for (Search *search : {engineA, engineB}) {
+        search->setSilent(true);
+        search->setNumThreads(options.threads);
+        search->setHashSize(options.hashMB);
+    }
+
+    TimeManagement limitB = options.limit;
+    limitB.allotment = std::max(1, (int) ((int64_t) options.limit.allotment * options.odds / 100));
+
+    for (unsigned int g = job->nextGame++; g < job->games && !job->isDecided; g = job->nextGame++) {
+        // Each opening is played twice in a row, with colors reversed
+        MatchGame game;
+        game.round = g + 1;
+        game.start = job->openings[(g / 2) % job->openings.size()];
+        game.isEngineAWhite = (g % 2 == 0);
+
+        engineA->clearTables();
+        engineB->clearTables();
+        if (game.isEngineAWhite)
+            playGame(job, engineA, engineB, options.limit, limitB, game);
+        else
+            playGame(job, engineB, engineA, limitB, options.limit, game);
+
+        std::string pgn = gameToPGN(game);
+        std::lock_guard<std::mutex> lock(job->resultMutex);
+        bool isWhiteWin = (game.result == "1-0");
+        bool isBlackWin = (game.result == "0-1");
+        if (!isWhiteWin && !isBlackWin)
+            job->draws++;
+        else if (isWhiteWin == game.isEngineAWhite)
+            job->wins++;
+        else
+            job->losses++;
+
+        if (job->pgnFile.is_open())
+            job->pgnFile << pgn << endl;
+        else
+            writeLine(pgn);
+
+        if (options.useSPRT) {
+            double llr = getLLR(job->wins, job->draws, job->losses, options.elo0, options.elo1);
+            if (llr >= std::log((1 - SPRT_BETA) / SPRT_ALPHA) || llr <= std::log(SPRT_BETA / (1 - SPRT_ALPHA)))
+                job->isDecided = true;
+        }
+    }
+
+    delete engineA;
+    delete engineB;
+}
+
+// Plays out a game from its opening, adjudicating it when both engines agree
+// on the outcome
+static void playGame(MatchJob *job, Search *white, Search *black, const TimeManagement &whiteLimit,
+        const TimeManagement &blackLimit, MatchGame &game) {
+    Board board = game.start.staticCopy();
+    TwoFoldStack history;
+    GameOutcome outcome = playAdjudicatedGame(board, history, white, black, whiteLimit, blackLimit,
+        [job, &game](const Board &, const SearchResult &result, int, int) {
+            job->nodes += result.nodes;
+            game.moves.push_back(result.bestMove);
+            return true;
+        });
+
+    game.result = (outcome.winner == WHITE) ? "1-0" : (outcome.winner == BLACK) ? "0-1" : "1/2-1/2";
+    game.termination = outcome.termination;
+}
+
+static std::string gameToPGN(const MatchGame &game) {
+    std::ostringstream out;
+    std::string fen = boardToFEN(game.start);
+    out << "[Event \"Laser match\"]\n";
+    out << "[Round \"" << game.round << "\"]\n";
+    out << "[White \"" << (game.isEngineAWhite ? "Laser A" : "Laser B") << "\"]\n";
+    out << "[Black \"" << (game.isEngineAWhite ? "Laser B" : "Laser A") << "\"]\n";
+    out << "[Result \"" << game.result << "\"]\n";
+    if (fen != STARTPOS) {
+        out << "[FEN \"" << fen << "\"]\n";
+        out << "[SetUp \"1\"]\n";
+    }
+    out << "[PlyCount \"" << game.moves.size() << "\"]\n";
+    out << "[Termination \"" << game.termination << "\"]\n\n";
+
+    Board board = game.start.staticCopy();
+    std::string line;
+    for (unsigned int ply = 0; ply < game.moves.size(); ply++) {
+        const int color = board.getPlayerToMove();
+        std::string token;
+        if (color == WHITE)
+            token = std::to_string(board.getMoveNumber()) + ". ";
+        else if (ply == 0)
+            token = std::to_string(board.getMoveNumber()) + "... ";
+        token += moveToSAN(game.moves[ply], board);
+        appendMovetext(out, line, token);
+        board.doMove(game.moves[ply], color);
+    }
+    appendMovetext(out, line, "{" + game.termination + "} " + game.result);
+    out << line << "\n";
+    return out.str();
+}
+
+/*
+ * Plays out a game from the given position and history, with each side
+ * searching under its own limit. Besides the rules of the game, it ends when
+ * both sides agree for RESIGN_MOVES moves each that one is winning, or for
+ * DRAW_MOVES moves each after DRAW_MIN_PLY that it is drawn.
+ */
+GameOutcome playAdjudicatedGame(Board &board, TwoFoldStack &history, Search *white, Search *black,
+        const TimeManagement &whiteLimit, const TimeManagement &blackLimit, const PlyCallback &onPly) {
+    MoveList movesToSearch;
+    // Consecutive plies on which the side to move agreed on the winner, or on
+    // a drawn score
+    int winningSide = -1, resignPlies = 0, drawPlies = 0;
+
+    for (int ply = 0; ; ply++) {
+        const int color = board.getPlayerToMove();
+        MoveList legalMoves = board.getAllLegalMoves(color);
+        if (legalMoves.size() == 0) {
+            if (board.isInCheck(color))
+                return {color ^ 1, (color == WHITE) ? "Black mates" : "White mates"};
+            return {-1, "Stalemate"};
+        }
+
+        if (board.getFiftyMoveCounter() >= 100)
+            return {-1, "Draw by fifty move rule"};
+        if (board.isInsufficientMaterial())
+            return {-1, "Draw by insufficient material"};
+        if (isRepetition(history, board.getZobristKey()))
+            return {-1, "Draw by repetition"};
+        if (ply >= MATCH_MAX_PLIES)
+            return {-1, "Draw by maximum game length"};
+
+        Search *search = (color == WHITE) ? white : black;
+        TimeManagement limit = (color == WHITE) ? whiteLimit : blackLimit;
+        TwoFoldStack *twoFoldPositions = search->getTwoFoldStackPointer();
+        *twoFoldPositions = history;
+        twoFoldPositions->setRootEnd();
+
+        search->isStop = false;
+        search->stopSignal = false;
+        search->getBestMoveThreader(&board, &limit, &movesToSearch);
+        search->isStop = true;
+        search->stopSignal = true;
+
+        const SearchResult &result = search->getResult();
+        Move m = result.bestMove;
+        int score = result.score * 100 / PIECE_VALUES[EG][PAWNS];
+        if (!onPly(board, result, ply, score))
+            return {-1, ""};
+
+        if (std::abs(score) >= RESIGN_SCORE) {
+            int winner = (score > 0) ? color : color ^ 1;
+            resignPlies = (winner == winningSide) ? resignPlies + 1 : 1;
+            winningSide = winner;
+        }
+        else
+            resignPlies = 0;
+        drawPlies = (ply >= DRAW_MIN_PLY && std::abs(score) <= DRAW_SCORE) ? drawPlies + 1 : 0;
+
+        pushHistory(history, board, m);
+        board.doMove(m, color);
+
+        if (resignPlies >= 2 * RESIGN_MOVES)
+            return {winningSide, (winningSide == WHITE) ? "White wins by adjudication" : "Black wins by adjudication"};
+        if (drawPlies >= 2 * DRAW_MOVES)
+            return {-1, "Draw by adjudication"};
+    }
+}
+
+// Records the position before move m for repetition detection. Captures,
+// pawn moves, and castles are irreversible, so they clear the history.
+void pushHistory(TwoFoldStack &history, const Board &board, Move m) {
+    const int color = board.getPlayerToMove();
+    history.push(board.getZobristKey());
+    if (isCapture(m) || isCastle(m) || (indexToBit(getStartSq(m)) & board.getPieces(color, PAWNS)))
+        history.clear();
+}
+
+// A position is drawn once it occurs for the third time
+bool isRepetition(const TwoFoldStack &history, uint64_t key) {
+    int occurrences = 0;
+    for (int i = 0; i < history.length; i++)
+        occurrences += (history.keys[i] == key);
+    return occurrences >= 2;
+}
+
+// Log-likelihood ratio of elo1 against elo0 for the observed results, using
+// the normal approximation of the trinomial model
+static double getLLR(int wins, int draws, int losses, double elo0, double elo1) {
+    int games = wins + draws + losses;
+    if (wins == 0 || losses == 0)
+        return 0;
+    double score = (wins + 0.5 * draws) / games;
+    double variance = (wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score)
+                     + losses * score * score) / games;
+    double score0 = 1 / (1 + std::pow(10, -elo0 / 400));
+    double score1 = 1 / (1 + std::pow(10, -elo1 / 400));
+    return games * (score1 - score0) * (2 * score - score0 - score1) / (2 * variance);
+}
+
+static double scoreToElo(double score) {
+    score = std::max(0.001, std::min(0.999, score));
+    return -400 * std::log10(1 / score - 1);
+}
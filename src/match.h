@@ -0,0 +1,93 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MATCH_H__
+#define __MATCH_H__
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "search.h"
+#include "timeman.h"
+
+// Games still running after this many plies are drawn
+constexpr int MATCH_MAX_PLIES = 600;
+// A game is adjudicated as a win once both sides agree, for this many moves
+// each, that one side is ahead by at least this many centipawns
+constexpr int RESIGN_SCORE = 1000;
+constexpr int RESIGN_MOVES = 4;
+// A game is adjudicated as a draw after DRAW_MIN_PLY once both sides score it
+// within this many centipawns of 0 for this many moves each
+constexpr int DRAW_SCORE = 10;
+constexpr int DRAW_MOVES = 8;
+constexpr int DRAW_MIN_PLY = 80;
+// Error probabilities of the sequential probability ratio test
+constexpr double SPRT_ALPHA = 0.05;
+constexpr double SPRT_BETA = 0.05;
+
+/**
+ * @brief Settings for a self-play match from the command line:
+ *   laser match <openings> [depth <n> | nodes <n> | movetime <ms>]
+ *       [odds <percent>] [games <n>] [workers <n>] [threads <n>] [hash <MB>]
+ *       [pgn <file>] [sprt <elo0> <elo1>]
+ * Engine A searches with the given limit and engine B with odds percent of
+ * it. Each opening of the EPD file is played twice with colors reversed.
+ * Every worker plays one game at a time, with a search, hash table and
+ * per-thread memory of its own for each engine.
+ */
+struct MatchOptions {
+    std::string openingFile;
+    TimeManagement limit;
+    int odds;
+    // 0 plays every opening twice
+    int games;
+    int workers;
+    int threads;
+    uint64_t hashMB;
+    std::string pgnFile;
+    // Stop early once the SPRT of elo0 against elo1 is decided
+    bool useSPRT;
+    double elo0;
+    double elo1;
+
+    MatchOptions();
+};
+
+/**
+ * @brief How a game played by playAdjudicatedGame() ended. The winner is WHITE,
+ * BLACK, or -1 for a draw. The termination is empty if the game was stopped by
+ * its ply callback.
+ */
+struct GameOutcome {
+    int winner;
+    std::string termination;
+};
+
+// Receives each position of a game before its move is played, with the search
+// result for it, the ply from the start of the game and the score in
+// centipawns. Returning false stops the game.
+typedef std::function<bool(const Board &, const SearchResult &, int, int)> PlyCallback;
+
+bool parseMatchOptions(int argc, char **argv, MatchOptions &options);
+void runMatch(const MatchOptions &options);
+GameOutcome playAdjudicatedGame(Board &board, TwoFoldStack &history, Search *white, Search *black,
+    const TimeManagement &whiteLimit, const TimeManagement &blackLimit, const PlyCallback &onPly);
+void pushHistory(TwoFoldStack &history, const Board &board, Move m);
+bool isRepetition(const TwoFoldStack &history, uint64_t key);
+
+#endif
@@ -0,0 +1,409 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Times the primitives the search spends most of its time in, each over the
+ * same fixed set of positions:
+ *   laser-microbench [runs <n>] [<name>...]
+ * Every benchmark is warmed up first, then timed over several runs of a
+ * fixed number of passes over the set. The mean, best and standard deviation
+ * of the time per operation are reported. Names given on the command line
+ * select the benchmarks whose names contain any of them.
+ * The checksum printed at the end depends on the results of one untimed pass
+ * of every benchmark run, and should only change when the behavior of a
+ * primitive changes.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "bbinit.h"
+#include "board.h"
+#include "common.h"
+#include "eval.h"
+#include "hash.h"
+#include "search.h"
+#include "moveorder.h"
+#include "notation.h"
+#include "uci.h"
+
+using std::cout;
+using std::endl;
+
+// Random games of this many plies are played from each starting position
+constexpr int MICROBENCH_WALKS = 8;
+constexpr int MICROBENCH_WALK_PLIES = 40;
+constexpr uint64_t MICROBENCH_SEED = 0x5EED5EED5EED5EEDULL;
+// Time spent warming up each benchmark, which also sets the passes per run
+constexpr uint64_t MICROBENCH_WARMUP_TIME = 200;
+constexpr uint64_t MICROBENCH_RUN_TIME = 100;
+constexpr int DEFAULT_MICROBENCH_RUNS = 5;
+constexpr int MICROBENCH_NAME_WIDTH = 32;
+
+// Receives the results of the timed passes, so that they are not optimized away
+static volatile uint64_t resultSink;
+
+// Starting positions of the random games that make up the position set
+static const std::vector<std::string> seedPositions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+    "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ -",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - -",
+    "2r2rk1/1p2npp1/1q1b1nbp/p2p4/P2N3P/BPN1P3/4BPP1/2RQ1RK1 w - -",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+    "8/3k2p1/p2P4/P5p1/8/1P1R1P2/5r2/3K4 w - -",
+    "4r3/6pp/2p1p1k1/4Q2n/1r2Pp2/8/6PP/2R3K1 w - -"
+};
+
+/**
+ * @brief A position of the set with the moves the benchmarks need
+ */
+struct MicrobenchPosition {
+    Board board;
+    int color;
+    MoveList legalMoves;
+    MoveList captures;
+};
+
+/**
+ * @brief One timed primitive. A pass performs the primitive on every
+ * position of the set, adds something of each result to the checksum, and
+ * returns the number of operations performed.
+ */
+struct Microbenchmark {
+    std::string name;
+    std::function<uint64_t(uint64_t &)> pass;
+};
+
+std::vector<MicrobenchPosition> buildPositionSet();
+std::vector<Microbenchmark> getMicrobenchmarks(std::vector<MicrobenchPosition> &positions);
+void runMicrobenchmark(const Microbenchmark &bench, int runs, uint64_t &checksum);
+uint64_t getNanoseconds(ChessTime startTime);
+
+
+int main(int argc, char **argv) {
+    initMagicTables(2563762638929852183ULL);
+    initEvalTables();
+    initDistances();
+    initZobristTable();
+    initInBetweenTable();
+    initReductionTable();
+
+    int runs = DEFAULT_MICROBENCH_RUNS;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "runs") == 0 && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else
+            filters.push_back(argv[i]);
+    }
+
+    std::vector<MicrobenchPosition> positions = buildPositionSet();
+    std::vector<Microbenchmark> benchmarks = getMicrobenchmarks(positions);
+
+    cout << "Positions : " << positions.size() << endl;
+    cout << "Runs      : " << runs << endl;
+    cout << std::left << std::setw(MICROBENCH_NAME_WIDTH) << "Benchmark" << std::right
+         << std::setw(10) << "ns/op" << std::setw(10) << "best" << std::setw(10) << "stdev" << endl;
+
+    uint64_t checksum = 0;
+    for (unsigned int i = 0; i < benchmarks.size(); i++) {
+        bool selected = filters.empty();
+        for (unsigned int j = 0; j < filters.size(); j++)
+            selected |= (benchmarks[i].name.find(filters[j]) != std::string::npos);
+        if (selected)
+            runMicrobenchmark(benchmarks[i], runs, checksum);
+    }
+
+    cout << "Checksum  : " << std::hex << std::setfill('0') << std::setw(16) << checksum << endl;
+    return 0;
+}
+
+// Collects every position of a number of random games from each of the seed
+// positions. The games are the same on every run and every machine.
+std::vector<MicrobenchPosition> buildPositionSet() {
+    std::mt19937_64 rng(MICROBENCH_SEED);
+    std::vector<MicrobenchPosition> positions;
+
+    for (unsigned int i = 0; i < seedPositions.size(); i++) {
+        for (int walk = 0; walk < MICROBENCH_WALKS; walk++) {
+            Board b = fenToBoard(seedPositions[i]);
+            for (int ply = 0; ply < MICROBENCH_WALK_PLIES; ply++) {
+                MicrobenchPosition position;
+                position.board = b;
+                position.color = b.getPlayerToMove();
+                position.legalMoves = b.getAllLegalMoves(position.color);
+                if (position.legalMoves.size() == 0)
+                    break;
+                b.getPseudoLegalCaptures(position.captures, position.color, false);
+                positions.push_back(position);
+
+                b.doMove(position.legalMoves.get((int) (rng() % position.legalMoves.size())),
+                    position.color);
+            }
+        }
+    }
+    return positions;
+}
+
+std::vector<Microbenchmark> getMicrobenchmarks(std::vector<MicrobenchPosition> &positions) {
+    std::vector<Microbenchmark> benchmarks;
+    std::vector<MicrobenchPosition> *set = &positions;
+
+    benchmarks.push_back({"Board::staticCopy", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            Board copy = p.board.staticCopy();
+            checksum += copy.getZobristKey();
+        }
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::staticCopy+doMove", [set](uint64_t &checksum) {
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            for (unsigned int i = 0; i < p.legalMoves.size(); i++) {
+                Board copy = p.board.staticCopy();
+                copy.doMove(p.legalMoves.get(i), p.color);
+                checksum += copy.getZobristKey();
+            }
+            ops += p.legalMoves.size();
+        }
+        return ops;
+    }});
+
+    benchmarks.push_back({"Board::getZobristKeyAfter", [set](uint64_t &checksum) {
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            for (unsigned int i = 0; i < p.legalMoves.size(); i++)
+                checksum += p.board.getZobristKeyAfter(p.legalMoves.get(i), p.color);
+            ops += p.legalMoves.size();
+        }
+        return ops;
+    }});
+
+    benchmarks.push_back({"Board::getAllLegalMoves", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set)
+            checksum += p.board.getAllLegalMoves(p.color).size();
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::getAllPseudoLegalMoves", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            MoveList moves;
+            p.board.getAllPseudoLegalMoves(moves, p.color);
+            checksum += moves.size();
+        }
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::getPseudoLegalCaptures", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            MoveList moves;
+            p.board.getPseudoLegalCaptures(moves, p.color, true);
+            checksum += moves.size();
+        }
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::getPseudoLegalQuiets", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            MoveList moves;
+            p.board.getPseudoLegalQuiets(moves, p.color);
+            checksum += moves.size();
+        }
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::getPseudoLegalChecks", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            MoveList moves;
+            p.board.getPseudoLegalChecks(moves, p.color);
+            checksum += moves.size();
+        }
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Board::getPseudoLegalCheckEscapes", [set](uint64_t &checksum) {
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            if (!p.board.isInCheck(p.color))
+                continue;
+            MoveList moves;
+            p.board.getPseudoLegalCheckEscapes(moves, p.color);
+            checksum += moves.size();
+            ops++;
+        }
+        return ops;
+    }});
+
+    benchmarks.push_back({"Board::isSEEAbove", [set](uint64_t &checksum) {
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            for (unsigned int i = 0; i < p.captures.size(); i++)
+                checksum += p.board.isSEEAbove(p.color, p.captures.get(i), 0);
+            ops += p.captures.size();
+        }
+        return ops;
+    }});
+
+    benchmarks.push_back({"Board::getAttackMap", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            for (int sq = 0; sq < 64; sq++)
+                checksum += p.board.getAttackMap(p.color, sq);
+        }
+        return (uint64_t) 64 * set->size();
+    }});
+
+    benchmarks.push_back({"Board::getBishopSquares", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            uint64_t occ = p.board.getAllPieces(WHITE) | p.board.getAllPieces(BLACK);
+            for (int sq = 0; sq < 64; sq++)
+                checksum += p.board.getBishopSquares(sq, occ);
+        }
+        return (uint64_t) 64 * set->size();
+    }});
+
+    benchmarks.push_back({"Board::getRookSquares", [set](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            uint64_t occ = p.board.getAllPieces(WHITE) | p.board.getAllPieces(BLACK);
+            for (int sq = 0; sq < 64; sq++)
+                checksum += p.board.getRookSquares(sq, occ);
+        }
+        return (uint64_t) 64 * set->size();
+    }});
+
+    benchmarks.push_back({"Eval::evaluate", [set](uint64_t &checksum) {
+        Eval e;
+        for (MicrobenchPosition &p : *set)
+            checksum += e.evaluate(p.board);
+        return (uint64_t) set->size();
+    }});
+
+    // The table is shared by the two hash benchmarks, and starts out holding
+    // every position so that Hash::get measures hits
+    std::shared_ptr<Hash> table(new Hash(DEFAULT_HASH_SIZE));
+    for (MicrobenchPosition &p : positions)
+        table->add(p.board, 0, p.legalMoves.get(0), 0, 0, PV_NODE);
+    benchmarks.push_back({"Hash::add", [set, table](uint64_t &checksum) {
+        int depth = 0;
+        for (MicrobenchPosition &p : *set) {
+            table->add(p.board, depth, p.legalMoves.get(0), depth, depth % MAX_DEPTH, PV_NODE);
+            depth++;
+        }
+        checksum += depth;
+        return (uint64_t) set->size();
+    }});
+
+    benchmarks.push_back({"Hash::get", [set, table](uint64_t &checksum) {
+        for (MicrobenchPosition &p : *set) {
+            HashEntry *entry = table->get(p.board);
+            checksum += (entry != nullptr) ? entry->move : 0;
+        }
+        return (uint64_t) set->size();
+    }});
+
+    // Move ordering reads the history tables, so they are kept for all passes
+    std::shared_ptr<SearchParameters> searchParams(new SearchParameters());
+    benchmarks.push_back({"MoveOrder::nextMove", [set, searchParams](uint64_t &checksum) {
+        SearchStackInfo ssi;
+        ssi.ply = 0;
+        ssi.staticEval = 0;
+        ssi.counterMoveHistory = nullptr;
+        ssi.followupMoveHistory = nullptr;
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            MoveList moves;
+            p.board.getAllPseudoLegalMoves(moves, p.color);
+            MoveOrder moveSorter(&p.board, p.color, 8, searchParams.get(), &ssi, NULL_MOVE, moves);
+            moveSorter.generateMoves();
+            for (Move m = moveSorter.nextMove(); m != NULL_MOVE; m = moveSorter.nextMove()) {
+                checksum += m;
+                ops++;
+            }
+        }
+        return ops;
+    }});
+
+    benchmarks.push_back({"MoveOrder::nextMove (qsearch)", [set, searchParams](uint64_t &checksum) {
+        uint64_t ops = 0;
+        for (MicrobenchPosition &p : *set) {
+            MoveOrder moveSorter(&p.board, p.color, 0, searchParams.get());
+            moveSorter.generateMoves();
+            for (Move m = moveSorter.nextMove(); m != NULL_MOVE; m = moveSorter.nextMove()) {
+                checksum += m;
+                ops++;
+            }
+        }
+        return ops;
+    }});
+
+    return benchmarks;
+}
+
+// Checks one benchmark, warms it up, then times the given number of runs
+void runMicrobenchmark(const Microbenchmark &bench, int runs, uint64_t &checksum) {
+    if (bench.pass(checksum) == 0) {
+        cout << std::left << std::setw(MICROBENCH_NAME_WIDTH) << bench.name << std::right
+             << std::setw(10) << "-" << endl;
+        return;
+    }
+
+    uint64_t sink = 0, warmupPasses = 0;
+    auto warmupStart = ChessClock::now();
+    while (getTimeElapsed(warmupStart) < MICROBENCH_WARMUP_TIME) {
+        bench.pass(sink);
+        warmupPasses++;
+    }
+    uint64_t passes = std::max((uint64_t) 1,
+        warmupPasses * MICROBENCH_RUN_TIME / std::max((uint64_t) 1, getTimeElapsed(warmupStart)));
+
+    std::vector<double> samples;
+    for (int run = 0; run < runs; run++) {
+        uint64_t ops = 0;
+        auto startTime = ChessClock::now();
+        for (uint64_t i = 0; i < passes; i++)
+            ops += bench.pass(sink);
+        samples.push_back((double) getNanoseconds(startTime) / ops);
+    }
+    resultSink = sink;
+
+    double mean = 0, variance = 0;
+    for (unsigned int i = 0; i < samples.size(); i++)
+        mean += samples[i] / samples.size();
+    for (unsigned int i = 0; i < samples.size(); i++)
+        variance += (samples[i] - mean) * (samples[i] - mean) / std::max(1, (int) samples.size() - 1);
+
+    cout << std::left << std::setw(MICROBENCH_NAME_WIDTH) << bench.name << std::right << std::fixed << std::setprecision(2)
+         << std::setw(10) << mean
+         << std::setw(10) << *std::min_element(samples.begin(), samples.end())
+         << std::setw(10) << std::sqrt(variance) << endl;
+}
+
+uint64_t getNanoseconds(ChessTime startTime) {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        ChessClock::now() - startTime).count();
+}
@@ -16,6 +16,7 @@
     along with Laser.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "instrument.h"
 #include "search.h"
 #include "moveorder.h"
 
@@ -148,6 +149,7 @@ void MoveOrder::generateMoves() {
 
 // Sort captures using SEE and MVV/LVA
 void MoveOrder::scoreCaptures() {
+    INSTRUMENT_SCOPE(IC_SCORE_CAPTURES);
     for (unsigned int i = 0; i < quietStart; i++) {
         Move m = legalMoves.get(i);
         int startSq = getStartSq(m);
@@ -163,6 +165,7 @@ void MoveOrder::scoreCaptures() {
 }
 
 void MoveOrder::scoreQuiets() {
+    INSTRUMENT_SCOPE(IC_SCORE_QUIETS);
     for (unsigned int i = quietStart; i < legalMoves.size(); i++) {
         Move m = legalMoves.get(i);
 
@@ -0,0 +1,476 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include "notation.h"
+#include "search.h"
+
+constexpr char PIECE_CHARS[] = "PNBRQKpnbrqk";
+constexpr char PROMOTION_CHARS[] = " nbrq";
+constexpr char SAN_PIECE_CHARS[] = "PNBRQK";
+
+static bool isDelimiter(char c, char delimiter);
+static int pieceIndex(char c);
+static bool parseCastlingRights(StringView field, uint8_t &castlingRights);
+static bool parseNumber(StringView field, int &value);
+static int writeNumber(char *buffer, unsigned int value);
+
+
+// Returns the next token of text, skipping any leading delimiters, and
+// advances text past it. A space delimiter also matches tabs and line endings
+// so that lines read from files can be parsed as is.
+StringView nextToken(StringView &text, char delimiter) {
+    const char *begin = text.begin;
+    while (begin < text.end && isDelimiter(*begin, delimiter))
+        begin++;
+    const char *end = begin;
+    while (end < text.end && !isDelimiter(*end, delimiter))
+        end++;
+    text.begin = end;
+    return StringView(begin, end);
+}
+
+/*
+ * Parses a FEN, or the position fields of an EPD record, directly into board
+ * without any heap allocation. The castling, en passant, and move counter
+ * fields are optional. If rest is given, it is set to the text following the
+ * fields that were parsed, e.g. EPD operations or the move list of a position
+ * command. Returns false, leaving board untouched, if the text does not
+ * describe a position with one king per side.
+ */
+bool parseFEN(StringView fen, Board &board, StringView *rest) {
+    int mailbox[64];
+    for (int i = 0; i < 64; i++)
+        mailbox[i] = -1;
+
+    // Piece placement, from a8 to h1
+    StringView placement = nextToken(fen);
+    int rank = 7, file = 0;
+    int kingCount[2] = {0, 0};
+    for (const char *c = placement.begin; c < placement.end; c++) {
+        if (*c == '/') {
+            if (file != 8 || rank == 0)
+                return false;
+            rank--;
+            file = 0;
+        }
+        else if ('1' <= *c && *c <= '8') {
+            file += *c - '0';
+            if (file > 8)
+                return false;
+        }
+        else {
+            int piece = pieceIndex(*c);
+            if (piece == -1 || file >= 8)
+                return false;
+            if (piece % 6 == KINGS)
+                kingCount[piece / 6]++;
+            mailbox[8 * rank + file] = piece;
+            file++;
+        }
+    }
+    if (rank != 0 || file != 8 || kingCount[WHITE] != 1 || kingCount[BLACK] != 1)
+        return false;
+
+    StringView side = nextToken(fen);
+    int playerToMove;
+    if (side == "w")
+        playerToMove = WHITE;
+    else if (side == "b")
+        playerToMove = BLACK;
+    else
+        return false;
+
+    // The remaining fields are only consumed if they have the expected form,
+    // so that a following "moves" or EPD opcode is left alone.
+    uint8_t castlingRights = 0;
+    StringView next = fen;
+    if (parseCastlingRights(nextToken(next), castlingRights))
+        fen = next;
+
+    uint16_t epCaptureFile = NO_EP_POSSIBLE;
+    next = fen;
+    StringView ep = nextToken(next);
+    if (ep == "-")
+        fen = next;
+    else if (ep.length() == 2 && 'a' <= ep[0] && ep[0] <= 'h' && (ep[1] == '3' || ep[1] == '6')) {
+        epCaptureFile = ep[0] - 'a';
+        fen = next;
+    }
+
+    int fiftyMoveCounter = 0;
+    int moveNumber = 1;
+    next = fen;
+    if (parseNumber(nextToken(next), fiftyMoveCounter)) {
+        fen = next;
+        if (parseNumber(nextToken(next), moveNumber))
+            fen = next;
+    }
+
+    if (rest != nullptr) {
+        while (!fen.empty() && isDelimiter(*fen.begin, ' '))
+            fen.begin++;
+        *rest = fen;
+    }
+
+    board = Board(mailbox, castlingRights & WHITEKSIDE, castlingRights & BLACKKSIDE,
+        castlingRights & WHITEQSIDE, castlingRights & BLACKQSIDE, epCaptureFile,
+        fiftyMoveCounter, moveNumber, playerToMove);
+    return true;
+}
+
+// Writes the FEN of board into buffer, which must hold at least MAX_FEN_LENGTH
+// characters. The result is null-terminated; its length is returned.
+int writeFEN(const Board &board, char *buffer) {
+    int mailbox[64];
+    board.getMailbox(mailbox);
+    char *out = buffer;
+
+    for (int r = 7; r >= 0; r--) {
+        int emptyCt = 0;
+        for (int f = 0; f < 8; f++) {
+            int piece = mailbox[8*r + f];
+            if (piece == -1)
+                emptyCt++;
+            else {
+                if (emptyCt) {
+                    *out++ = (char) ('0' + emptyCt);
+                    emptyCt = 0;
+                }
+                *out++ = PIECE_CHARS[piece];
+            }
+        }
+
+        if (emptyCt)
+            *out++ = (char) ('0' + emptyCt);
+        if (r != 0)
+            *out++ = '/';
+    }
+
+    *out++ = ' ';
+    *out++ = (board.getPlayerToMove() == WHITE) ? 'w' : 'b';
+    *out++ = ' ';
+    char *castlingStart = out;
+    if (board.getWhiteCanKCastle()) *out++ = 'K';
+    if (board.getWhiteCanQCastle()) *out++ = 'Q';
+    if (board.getBlackCanKCastle()) *out++ = 'k';
+    if (board.getBlackCanQCastle()) *out++ = 'q';
+    if (out == castlingStart) *out++ = '-';
+    *out++ = ' ';
+
+    uint16_t epCaptureFile = board.getEPCaptureFile();
+    if (epCaptureFile == NO_EP_POSSIBLE)
+        *out++ = '-';
+    else {
+        *out++ = (char) ('a' + epCaptureFile);
+        *out++ = (board.getPlayerToMove() == WHITE) ? '6' : '3';
+    }
+
+    *out++ = ' ';
+    out += writeNumber(out, board.getFiftyMoveCounter());
+    *out++ = ' ';
+    out += writeNumber(out, board.getMoveNumber());
+    *out = '\0';
+
+    return (int) (out - buffer);
+}
+
+// Convenience wrappers. An invalid FEN gives the start position.
+Board fenToBoard(StringView fen) {
+    Board board;
+    parseFEN(fen, board);
+    return board;
+}
+
+std::string boardToFEN(const Board &board) {
+    char buffer[MAX_FEN_LENGTH];
+    int length = writeFEN(board, buffer);
+    return std::string(buffer, length);
+}
+
+// Converts a move in long algebraic notation to our move format. Returns
+// NULL_MOVE if the string is too short to be a move.
+Move stringToMove(StringView moveStr, const Board &b, bool &reversible) {
+    reversible = true;
+    if (moveStr.length() < 4)
+        return NULL_MOVE;
+
+    int startSq = 8 * (moveStr[1] - '1') + (moveStr[0] - 'a');
+    int endSq = 8 * (moveStr[3] - '1') + (moveStr[2] - 'a');
+    if (startSq < 0 || startSq > 63 || endSq < 0 || endSq > 63)
+        return NULL_MOVE;
+
+    int color = b.getPlayerToMove();
+    bool isCapture = (bool)(indexToBit(endSq) & b.getAllPieces(color ^ 1));
+    bool isPawnMove = (bool)(indexToBit(startSq) & b.getPieces(color, PAWNS));
+    bool isKingMove = (bool)(indexToBit(startSq) & b.getPieces(color, KINGS));
+
+    bool isEP = (isPawnMove && !isCapture && ((endSq - startSq) & 1));
+    bool isDoublePawn = (isPawnMove && abs(endSq - startSq) == 16);
+    bool isCastle = (isKingMove && abs(endSq - startSq) == 2);
+    int promotion = 0;
+    if (moveStr.length() == 5 && moveStr[4] != '\0') {
+        const char *promotionChar = std::strchr(PROMOTION_CHARS, moveStr[4]);
+        if (promotionChar != nullptr)
+            promotion = (int) (promotionChar - PROMOTION_CHARS);
+    }
+
+    Move m = encodeMove(startSq, endSq);
+    m = setCapture(m, isCapture);
+    m = setCastle(m, isCastle);
+    if (isEP)
+        m = setFlags(m, MOVE_EP);
+    else if (promotion) {
+        m = setFlags(m, MOVE_PROMO_N + promotion - 1);
+    }
+    else if (isDoublePawn)
+        m = setFlags(m, MOVE_DOUBLE_PAWN);
+
+    reversible = !(isCapture || isPawnMove || isCastle);
+    return m;
+}
+
+/*
+ * Plays a space-separated list of moves in long algebraic notation, recording
+ * the positions of the game for repetition detection. Stops at the first
+ * illegal or malformed move and returns false.
+ */
+bool playMoves(StringView moveList, Board &board, TwoFoldStack *twoFoldPositions) {
+    for (StringView moveStr = nextToken(moveList); !moveStr.empty(); moveStr = nextToken(moveList)) {
+        bool reversible;
+        Move m = stringToMove(moveStr, board, reversible);
+
+        MoveList legalMoves = board.getAllLegalMoves(board.getPlayerToMove());
+        bool isLegal = false;
+        for (unsigned int i = 0; i < legalMoves.size(); i++)
+            isLegal |= (legalMoves.get(i) == m);
+        if (m == NULL_MOVE || !isLegal)
+            return false;
+
+        twoFoldPositions->push(board.getZobristKey());
+        // Captures, pawn moves, and castles are irreversible
+        if (!reversible)
+            twoFoldPositions->clear();
+        board.doMove(m, board.getPlayerToMove());
+    }
+    twoFoldPositions->setRootEnd();
+    return true;
+}
+
+/*
+ * Converts a move in standard algebraic notation, e.g. "Nbd7", "exd8=Q+" or
+ * "O-O", to our move format by matching it against the legal moves. Check and
+ * annotation suffixes are ignored. Returns NULL_MOVE if the move is illegal,
+ * ambiguous or malformed.
+ */
+Move sanToMove(StringView san, const Board &b) {
+    while (!san.empty() && std::strchr("+#!?", san.end[-1]) != nullptr)
+        san.end--;
+
+    const int color = b.getPlayerToMove();
+    MoveList legalMoves = b.getAllLegalMoves(color);
+
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+        bool kingside = (san.length() == 3);
+        for (unsigned int i = 0; i < legalMoves.size(); i++) {
+            Move m = legalMoves.get(i);
+            if (isCastle(m) && (getEndSq(m) > getStartSq(m)) == kingside)
+                return m;
+        }
+        return NULL_MOVE;
+    }
+
+    int piece = PAWNS;
+    if (!san.empty() && san[0] != 'P' && std::strchr(SAN_PIECE_CHARS, san[0]) != nullptr) {
+        piece = (int) (std::strchr(SAN_PIECE_CHARS, san[0]) - SAN_PIECE_CHARS);
+        san.begin++;
+    }
+
+    // Promotions are written as e8=Q, or sometimes e8Q
+    int promotion = 0;
+    if (piece == PAWNS && san.length() >= 3 && std::strchr("NBRQ", san.end[-1]) != nullptr) {
+        promotion = (int) (std::strchr(SAN_PIECE_CHARS, san.end[-1]) - SAN_PIECE_CHARS);
+        san.end--;
+        if (san.end[-1] == '=')
+            san.end--;
+    }
+
+    if (san.length() < 2)
+        return NULL_MOVE;
+    int endFile = san.end[-2] - 'a';
+    int endRank = san.end[-1] - '1';
+    if (endFile < 0 || endFile > 7 || endRank < 0 || endRank > 7)
+        return NULL_MOVE;
+    int endSq = 8 * endRank + endFile;
+
+    // Anything left over is disambiguation and the capture sign
+    int startFile = -1, startRank = -1;
+    for (const char *c = san.begin; c < san.end - 2; c++) {
+        if ('a' <= *c && *c <= 'h')
+            startFile = *c - 'a';
+        else if ('1' <= *c && *c <= '8')
+            startRank = *c - '1';
+        else if (*c != 'x' && *c != ':' && *c != '-')
+            return NULL_MOVE;
+    }
+
+    Move match = NULL_MOVE;
+    for (unsigned int i = 0; i < legalMoves.size(); i++) {
+        Move m = legalMoves.get(i);
+        int startSq = getStartSq(m);
+        if (getEndSq(m) != endSq || isCastle(m)
+         || b.getPieceOnSquare(color, startSq) != piece
+         || getPromotion(m) != promotion
+         || (startFile != -1 && (startSq & 7) != startFile)
+         || (startRank != -1 && (startSq >> 3) != startRank))
+            continue;
+        if (match != NULL_MOVE)
+            return NULL_MOVE;
+        match = m;
+    }
+    return match;
+}
+
+// Writes a legal move in standard algebraic notation, including the check or
+// mate sign.
+std::string moveToSAN(Move m, const Board &b) {
+    const int color = b.getPlayerToMove();
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+    int piece = b.getPieceOnSquare(color, startSq);
+    std::string san;
+
+    if (isCastle(m))
+        san = (endSq > startSq) ? "O-O" : "O-O-O";
+    else {
+        if (piece != PAWNS) {
+            san += SAN_PIECE_CHARS[piece];
+
+            // Disambiguate from other pieces of the same type that can reach
+            // the same square, by file if possible, then by rank
+            MoveList legalMoves = b.getAllLegalMoves(color);
+            bool isAmbiguous = false, sameFile = false, sameRank = false;
+            for (unsigned int i = 0; i < legalMoves.size(); i++) {
+                Move other = legalMoves.get(i);
+                int otherSq = getStartSq(other);
+                if (getEndSq(other) != endSq || otherSq == startSq || isCastle(other)
+                 || b.getPieceOnSquare(color, otherSq) != piece)
+                    continue;
+                isAmbiguous = true;
+                sameFile |= ((otherSq & 7) == (startSq & 7));
+                sameRank |= ((otherSq >> 3) == (startSq >> 3));
+            }
+            if (isAmbiguous && (!sameFile || sameRank))
+                san += (char) ('a' + (startSq & 7));
+            if (isAmbiguous && sameFile)
+                san += (char) ('1' + (startSq >> 3));
+        }
+        else if (isCapture(m))
+            san += (char) ('a' + (startSq & 7));
+
+        if (isCapture(m))
+            san += 'x';
+        san += (char) ('a' + (endSq & 7));
+        san += (char) ('1' + (endSq >> 3));
+        if (getPromotion(m)) {
+            san += '=';
+            san += SAN_PIECE_CHARS[getPromotion(m)];
+        }
+    }
+
+    Board copy = b.staticCopy();
+    copy.doMove(m, color);
+    if (copy.isInCheck(color ^ 1))
+        san += (copy.getAllLegalMoves(color ^ 1).size() == 0) ? '#' : '+';
+    return san;
+}
+
+// Splits a string s with delimiter d.
+std::vector<std::string> split(const std::string &s, char d) {
+    std::vector<std::string> v;
+    std::size_t start = 0;
+    while (start < s.length()) {
+        std::size_t end = s.find(d, start);
+        if (end == std::string::npos)
+            end = s.length();
+        v.emplace_back(s, start, end - start);
+        start = end + 1;
+    }
+    return v;
+}
+
+
+static bool isDelimiter(char c, char delimiter) {
+    return c == delimiter
+        || (delimiter == ' ' && (c == '\t' || c == '\r' || c == '\n'));
+}
+
+static int pieceIndex(char c) {
+    for (int i = 0; i < 12; i++) {
+        if (PIECE_CHARS[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+static bool parseCastlingRights(StringView field, uint8_t &castlingRights) {
+    if (field == "-")
+        return true;
+    if (field.empty())
+        return false;
+
+    uint8_t rights = 0;
+    for (const char *c = field.begin; c < field.end; c++) {
+        switch (*c) {
+            case 'K': rights |= WHITEKSIDE; break;
+            case 'Q': rights |= WHITEQSIDE; break;
+            case 'k': rights |= BLACKKSIDE; break;
+            case 'q': rights |= BLACKQSIDE; break;
+            default: return false;
+        }
+    }
+    castlingRights = rights;
+    return true;
+}
+
+static bool parseNumber(StringView field, int &value) {
+    if (field.empty() || field.length() > 9)
+        return false;
+
+    int result = 0;
+    for (const char *c = field.begin; c < field.end; c++) {
+        if (*c < '0' || *c > '9')
+            return false;
+        result = 10 * result + (*c - '0');
+    }
+    value = result;
+    return true;
+}
+
+static int writeNumber(char *buffer, unsigned int value) {
+    char digits[10];
+    int length = 0;
+    do {
+        digits[length++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    for (int i = 0; i < length; i++)
+        buffer[i] = digits[length - 1 - i];
+    return length;
+}
@@ -0,0 +1,75 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __NOTATION_H__
+#define __NOTATION_H__
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "board.h"
+#include "common.h"
+
+struct TwoFoldStack;
+
+// Enough for the longest possible FEN and a terminating null character
+constexpr int MAX_FEN_LENGTH = 96;
+constexpr char STARTPOS[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+/**
+ * @brief A non-owning view of a range of characters. This lets positions and
+ * moves be parsed in place out of input lines and file buffers without
+ * copying them into std::strings first.
+ */
+struct StringView {
+    const char *begin;
+    const char *end;
+
+    StringView() : begin(nullptr), end(nullptr) {}
+    StringView(const char *_begin, const char *_end) : begin(_begin), end(_end) {}
+    StringView(const char *s) : begin(s), end(s + std::strlen(s)) {}
+    StringView(const std::string &s) : begin(s.data()), end(s.data() + s.size()) {}
+
+    std::size_t length() const { return (std::size_t) (end - begin); }
+    bool empty() const { return begin >= end; }
+    char operator[](std::size_t i) const { return begin[i]; }
+    bool operator==(const char *s) const {
+        return std::strlen(s) == length() && std::strncmp(begin, s, length()) == 0;
+    }
+    std::string toString() const { return std::string(begin, end); }
+};
+
+StringView nextToken(StringView &text, char delimiter = ' ');
+
+// Allocation-free FEN/EPD parsing and writing
+bool parseFEN(StringView fen, Board &board, StringView *rest = nullptr);
+int writeFEN(const Board &board, char *buffer);
+
+Board fenToBoard(StringView fen);
+std::string boardToFEN(const Board &board);
+
+Move stringToMove(StringView moveStr, const Board &b, bool &reversible);
+bool playMoves(StringView moveList, Board &board, TwoFoldStack *twoFoldPositions);
+
+// Standard algebraic notation, as used in PGN
+Move sanToMove(StringView san, const Board &b);
+std::string moveToSAN(Move m, const Board &b);
+
+std::vector<std::string> split(const std::string &s, char d);
+
+#endif
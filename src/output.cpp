@@ -0,0 +1,188 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "output.h"
+
+/*
+ * A bounded multi-producer, single-consumer queue of output lines, based on
+ * Dmitry Vyukov's sequence-numbered ring buffer. Each slot's sequence number
+ * tells producers whether the slot is free for the given position and tells
+ * the consumer whether it has been filled. Producers only ever contend on a
+ * single compare-and-swap, and lines come out in the order they claimed
+ * their positions, so info lines always precede the bestmove that follows
+ * them.
+ */
+struct OutputSlot {
+    std::atomic<uint64_t> sequence;
+    std::string line;
+};
+
+static OutputSlot outputQueue[OUTPUT_QUEUE_SIZE];
+static std::atomic<uint64_t> enqueuePos(0);
+// Only touched by the output thread
+static uint64_t dequeuePos = 0;
+
+static std::thread outputThread;
+static std::atomic<bool> outputRunning(false);
+// Cleared by the output thread once it has been asked to stop. Producers
+// that still see it set are counted in activeWriters until their line is
+// published, and the output thread only exits after all of them are done
+// and the queue is empty.
+static std::atomic<bool> outputAccepting(false);
+static std::atomic<int> activeWriters(0);
+// Set once every queued line has been written, after which lines go
+// directly to stdout without overtaking queued ones
+static std::atomic<bool> outputDrained(true);
+// Set while the output thread is waiting for work, so that producers only
+// pay for a wakeup when it is actually needed.
+static std::atomic<bool> outputSleeping(false);
+static std::mutex wakeMutex;
+static std::condition_variable wakeCondition;
+
+
+static bool tryDequeue(std::string &line) {
+    OutputSlot *slot = &outputQueue[dequeuePos & (OUTPUT_QUEUE_SIZE - 1)];
+    if (slot->sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+        return false;
+
+    line = std::move(slot->line);
+    slot->line.clear();
+    // Release the slot for the producer one lap ahead
+    slot->sequence.store(dequeuePos + OUTPUT_QUEUE_SIZE, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+static bool isQueueEmpty() {
+    OutputSlot *slot = &outputQueue[dequeuePos & (OUTPUT_QUEUE_SIZE - 1)];
+    return slot->sequence.load(std::memory_order_seq_cst) != dequeuePos + 1;
+}
+
+// Drains the queue to stdout. The stream is flushed only once the queue has
+// been emptied, so bursts of info lines cost a single write.
+static void outputLoop() {
+    std::string line;
+    while (true) {
+        bool wroteLine = false;
+        while (tryDequeue(line)) {
+            std::cout << line << '\n';
+            wroteLine = true;
+        }
+        if (wroteLine) {
+            std::cout.flush();
+            continue;
+        }
+
+        if (!outputRunning.load(std::memory_order_acquire)) {
+            outputAccepting.store(false, std::memory_order_seq_cst);
+            if (activeWriters.load(std::memory_order_seq_cst) == 0
+             && dequeuePos == enqueuePos.load(std::memory_order_acquire))
+                break;
+            // A producer that got in before the flag was cleared is still
+            // publishing its line
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        outputSleeping.store(true, std::memory_order_seq_cst);
+        // Re-check after announcing that we are going to sleep: a producer
+        // either sees the flag or its line is already visible here.
+        if (isQueueEmpty() && outputRunning.load(std::memory_order_seq_cst))
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(100));
+        outputSleeping.store(false, std::memory_order_relaxed);
+    }
+    std::cout.flush();
+    outputDrained.store(true, std::memory_order_release);
+}
+
+void startOutputThread() {
+    if (outputRunning)
+        return;
+    for (unsigned int i = 0; i < OUTPUT_QUEUE_SIZE; i++)
+        outputQueue[i].sequence.store(i, std::memory_order_relaxed);
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos = 0;
+
+    outputDrained = false;
+    outputAccepting = true;
+    outputRunning = true;
+    outputThread = std::thread(outputLoop);
+}
+
+// Stops the output thread once everything queued so far has been written.
+void stopOutputThread() {
+    if (!outputRunning)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        outputRunning = false;
+    }
+    wakeCondition.notify_one();
+    outputThread.join();
+}
+
+// Queues a line for output. This never performs I/O: it only waits if the
+// output thread has fallen a full queue behind.
+void writeLine(std::string line) {
+    activeWriters.fetch_add(1, std::memory_order_seq_cst);
+    // Without an output thread (e.g. during shutdown), write directly once
+    // the lines already queued have been written
+    if (!outputAccepting.load(std::memory_order_seq_cst)) {
+        activeWriters.fetch_sub(1, std::memory_order_release);
+        while (!outputDrained.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        std::cout << line << std::endl;
+        return;
+    }
+
+    OutputSlot *slot;
+    uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &outputQueue[pos & (OUTPUT_QUEUE_SIZE - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = (int64_t) sequence - (int64_t) pos;
+
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        // The queue is full: give the output thread a chance to catch up
+        else if (diff < 0) {
+            std::this_thread::yield();
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        else
+            pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+
+    slot->line = std::move(line);
+    slot->sequence.store(pos + 1, std::memory_order_seq_cst);
+    activeWriters.fetch_sub(1, std::memory_order_release);
+
+    if (outputSleeping.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakeCondition.notify_one();
+    }
+}
@@ -0,0 +1,53 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <sstream>
+#include <string>
+
+// Must be a power of two
+constexpr unsigned int OUTPUT_QUEUE_SIZE = 1024;
+
+void startOutputThread();
+void stopOutputThread();
+void writeLine(std::string line);
+
+/**
+ * @brief Collects a single line of engine output, which is handed to the
+ * output thread as a whole when the object goes out of scope. Callers never
+ * touch stdout themselves, so a slow GUI or pipe cannot stall the search.
+ */
+class OutputLine {
+public:
+    OutputLine() {}
+    OutputLine(const OutputLine &other) = delete;
+    OutputLine& operator=(const OutputLine &other) = delete;
+    ~OutputLine() { writeLine(stream.str()); }
+
+    template <class T> OutputLine &operator<<(const T &t) {
+        stream << t;
+        return *this;
+    }
+
+private:
+    std::ostringstream stream;
+};
+
+#endif
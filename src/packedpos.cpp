@@ -0,0 +1,287 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "analysis.h"
+#include "notation.h"
+#include "packedpos.h"
+
+using std::cerr;
+using std::endl;
+
+// Positions written to a packed file at a time
+constexpr size_t PACKED_WRITE_BATCH = 4096;
+
+static const char *RESULT_STRINGS[4] = {"0-1", "1/2-1/2", "1-0", "*"};
+
+static bool hasExtension(const std::string &fileName, const char *extension);
+static bool packTextFile(const std::string &inputFile, const std::string &outputFile);
+static bool unpackToTextFile(const std::string &inputFile, const std::string &outputFile, bool fen);
+
+
+PackedPositionFile::PackedPositionFile() {
+    opened = false;
+    positions = nullptr;
+    numPositions = 0;
+    mappedSize = 0;
+}
+
+PackedPositionFile::~PackedPositionFile() {
+    close();
+}
+
+// Maps the file at path. Trailing bytes that do not make up a whole position
+// are ignored.
+bool PackedPositionFile::open(const std::string &path) {
+    close();
+
+#ifdef _WIN32
+    (void) path;
+    cerr << "Packed position files are not supported on this platform" << endl;
+    return false;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) != 0) {
+        ::close(fd);
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+
+    uint64_t count = (uint64_t) fileStatus.st_size / sizeof(PackedPosition);
+    // An empty file is a valid, empty set of positions, but cannot be mapped
+    if (count == 0) {
+        ::close(fd);
+        opened = true;
+        return true;
+    }
+
+    uint64_t size = count * sizeof(PackedPosition);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Could not map " << path << endl;
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    positions = static_cast<const PackedPosition *>(mapping);
+    numPositions = count;
+    mappedSize = size;
+    opened = true;
+    return true;
+#endif
+}
+
+void PackedPositionFile::close() {
+#ifndef _WIN32
+    if (mappedSize)
+        munmap(const_cast<PackedPosition *>(positions), mappedSize);
+#endif
+    opened = false;
+    positions = nullptr;
+    numPositions = 0;
+    mappedSize = 0;
+}
+
+
+PackedPosition packPosition(const Board &b, int16_t score, uint8_t result) {
+    PackedPosition p;
+    std::memset(&p, 0, sizeof(p));
+
+    p.occupancy = b.getAllPieces(WHITE) | b.getAllPieces(BLACK);
+
+    int mailbox[64];
+    b.getMailbox(mailbox);
+    int n = 0;
+    for (uint64_t occ = p.occupancy; occ; occ &= occ - 1, n++) {
+        int code = mailbox[bitScanForward(occ)];
+        uint8_t nibble = (uint8_t) ((code / 6) * 8 + code % 6);
+        p.pieces[n / 2] |= (uint8_t) (nibble << (4 * (n & 1)));
+    }
+
+    p.flags = (uint8_t) (b.getPlayerToMove() | (b.getCastlingRights() << 1));
+    p.epCaptureFile = (uint8_t) b.getEPCaptureFile();
+    p.fiftyMoveCounter = b.getFiftyMoveCounter();
+    p.result = result;
+    p.moveNumber = b.getMoveNumber();
+    p.score = score;
+    return p;
+}
+
+// Builds the board's bitboards straight from the packed nibbles
+Board unpackPosition(const PackedPosition &p) {
+    uint64_t bitboards[2][6] = {};
+
+    int n = 0;
+    for (uint64_t occ = p.occupancy; occ && n < 32; occ &= occ - 1, n++) {
+        int nibble = (p.pieces[n / 2] >> (4 * (n & 1))) & 0xF;
+        bitboards[(nibble >> 3) & 1][(nibble & 7) % 6] |= occ & (0 - occ);
+    }
+
+    return Board(bitboards, (uint8_t) ((p.flags >> 1) & 0xF), p.epCaptureFile,
+        p.fiftyMoveCounter, p.moveNumber, p.flags & 1);
+}
+
+bool isPackedPositionFile(const std::string &fileName) {
+    return hasExtension(fileName, PACKED_FILE_EXTENSION);
+}
+
+// The position as an EPD line, with the score as a centipawn evaluation
+// (ce) and the result as comment c9
+std::string packedToEPD(const PackedPosition &p) {
+    Board b = unpackPosition(p);
+    std::string fen = boardToFEN(b);
+    // Keep the four EPD fields, moving the counters into operations
+    size_t end = 0;
+    for (int fields = 0; fields < 4 && end != std::string::npos; fields++)
+        end = fen.find(' ', end + (fields > 0));
+    std::string epd = fen.substr(0, end);
+
+    epd += " hmvc " + std::to_string(b.getFiftyMoveCounter()) + ";";
+    epd += " fmvn " + std::to_string(b.getMoveNumber()) + ";";
+    if (p.score != PACKED_NO_SCORE)
+        epd += " ce " + std::to_string(p.score) + ";";
+    if (p.result != PACKED_NO_RESULT)
+        epd += std::string(" c9 \"") + RESULT_STRINGS[p.result & 3] + "\";";
+    return epd;
+}
+
+/*
+ * Converts between packed positions and FEN or EPD, in the direction given
+ * by the file names: a packed output file is filled from the FEN or EPD lines
+ * of the input, and otherwise a packed input file is written as EPD, or as
+ * plain FEN if the output file ends in ".fen".
+ */
+bool convertPositions(const std::string &inputFile, const std::string &outputFile) {
+    if (isPackedPositionFile(outputFile))
+        return packTextFile(inputFile, outputFile);
+    return unpackToTextFile(inputFile, outputFile, hasExtension(outputFile, ".fen"));
+}
+
+
+static bool hasExtension(const std::string &fileName, const char *extension) {
+    size_t length = std::strlen(extension);
+    return fileName.size() >= length && fileName.compare(fileName.size() - length, length, extension) == 0;
+}
+
+// Packs the FEN or EPD lines of a file, taking scores from ce operations,
+// results from c9 operations, and the counters of EPD lines from hmvc and
+// fmvn operations
+static bool packTextFile(const std::string &inputFile, const std::string &outputFile) {
+    std::ifstream in(inputFile);
+    if (!in) {
+        cerr << "Could not open " << inputFile << endl;
+        return false;
+    }
+    std::ofstream out(outputFile, std::ios::binary);
+    if (!out) {
+        cerr << "Could not open " << outputFile << endl;
+        return false;
+    }
+
+    std::vector<PackedPosition> batch;
+    batch.reserve(PACKED_WRITE_BATCH);
+    uint64_t positions = 0, errors = 0;
+    std::string line;
+    Board b;
+    for (unsigned int lineNumber = 1; std::getline(in, line); lineNumber++) {
+        StringView text(line);
+        StringView first = text;
+        first = nextToken(first);
+        if (first.empty() || first[0] == '#')
+            continue;
+
+        StringView operations;
+        if (!parseFEN(text, b, &operations)) {
+            errors++;
+            cerr << "Skipping invalid position on line " << lineNumber << endl;
+            continue;
+        }
+
+        PackedPosition p = packPosition(b);
+        uint64_t value = 0;
+        std::string operand = findEPDOperation(operations, "ce").toString();
+        if (!operand.empty()) {
+            bool negative = (operand[0] == '-');
+            if (parseNumber(operand.c_str() + negative, value) && value < 32768)
+                p.score = (int16_t) (negative ? -(int) value : (int) value);
+        }
+        StringView result = findEPDOperation(operations, "c9");
+        if (result == "1-0")
+            p.result = PACKED_WHITE_WIN;
+        else if (result == "0-1")
+            p.result = PACKED_BLACK_WIN;
+        else if (result == "1/2-1/2")
+            p.result = PACKED_DRAW;
+        if (parseNumber(findEPDOperation(operations, "hmvc").toString().c_str(), value))
+            p.fiftyMoveCounter = (uint8_t) std::min(value, (uint64_t) 255);
+        if (parseNumber(findEPDOperation(operations, "fmvn").toString().c_str(), value))
+            p.moveNumber = (uint16_t) std::min(value, (uint64_t) 65535);
+
+        batch.push_back(p);
+        if (batch.size() == PACKED_WRITE_BATCH) {
+            out.write(reinterpret_cast<const char *>(batch.data()), batch.size() * sizeof(PackedPosition));
+            positions += batch.size();
+            batch.clear();
+        }
+    }
+    out.write(reinterpret_cast<const char *>(batch.data()), batch.size() * sizeof(PackedPosition));
+    positions += batch.size();
+
+    cerr << "Positions : " << positions << endl;
+    cerr << "Errors    : " << errors << endl;
+    return true;
+}
+
+static bool unpackToTextFile(const std::string &inputFile, const std::string &outputFile, bool fen) {
+    PackedPositionFile in;
+    if (!in.open(inputFile))
+        return false;
+    std::ofstream out(outputFile);
+    if (!out) {
+        cerr << "Could not open " << outputFile << endl;
+        return false;
+    }
+
+    char buffer[MAX_FEN_LENGTH];
+    for (const PackedPosition &p : in) {
+        if (fen) {
+            writeFEN(unpackPosition(p), buffer);
+            out << buffer << '\n';
+        }
+        else
+            out << packedToEPD(p) << '\n';
+    }
+    cerr << "Positions : " << in.size() << endl;
+    return true;
+}
@@ -0,0 +1,93 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PACKEDPOS_H__
+#define __PACKEDPOS_H__
+
+#include <cstdint>
+#include <string>
+#include "board.h"
+
+// Game results of a packed position, from White's point of view
+constexpr uint8_t PACKED_BLACK_WIN = 0;
+constexpr uint8_t PACKED_DRAW = 1;
+constexpr uint8_t PACKED_WHITE_WIN = 2;
+constexpr uint8_t PACKED_NO_RESULT = 3;
+// Score field of a position without a search score
+constexpr int16_t PACKED_NO_SCORE = -32768;
+// Files with this extension hold packed positions rather than FEN or EPD
+constexpr const char *PACKED_FILE_EXTENSION = ".bin";
+
+/**
+ * @brief A position in a fixed 32 bytes, for datasets of millions of
+ * positions. The occupied squares are listed in the occupancy bitboard, and
+ * the piece on each of them, in order of increasing square index, is a nibble
+ * of color * 8 + piece type. The flags hold the side to move in bit 0 and the
+ * castling rights, in the board's encoding, in bits 1 to 4. Scores are in
+ * centipawns for the side to move. Fields are in native byte order, which is
+ * little-endian on every supported platform.
+ */
+struct PackedPosition {
+    uint64_t occupancy;
+    uint8_t pieces[16];
+    uint8_t flags;
+    uint8_t epCaptureFile;
+    uint8_t fiftyMoveCounter;
+    uint8_t result;
+    uint16_t moveNumber;
+    int16_t score;
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must be 32 bytes");
+
+/**
+ * @brief A read-only memory mapping of a file of packed positions. Positions
+ * are used in place, without copying or parsing, and the kernel reads the
+ * file ahead as it is streamed through.
+ */
+class PackedPositionFile {
+public:
+    PackedPositionFile();
+    PackedPositionFile(const PackedPositionFile &other) = delete;
+    PackedPositionFile& operator=(const PackedPositionFile &other) = delete;
+    ~PackedPositionFile();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return opened; }
+
+    uint64_t size() const { return numPositions; }
+    const PackedPosition &operator[](uint64_t i) const { return positions[i]; }
+    const PackedPosition *begin() const { return positions; }
+    const PackedPosition *end() const { return positions + numPositions; }
+
+private:
+    bool opened;
+    const PackedPosition *positions;
+    uint64_t numPositions;
+    uint64_t mappedSize;
+};
+
+PackedPosition packPosition(const Board &b, int16_t score = PACKED_NO_SCORE,
+    uint8_t result = PACKED_NO_RESULT);
+Board unpackPosition(const PackedPosition &p);
+bool isPackedPositionFile(const std::string &fileName);
+std::string packedToEPD(const PackedPosition &p);
+bool convertPositions(const std::string &inputFile, const std::string &outputFile);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "resultcache.h"
+
+using std::cerr;
+using std::endl;
+
+static const char RESULT_CACHE_MAGIC[8] = {'L', 'S', 'R', 'C', 'A', 'C', 'H', 'E'};
+
+
+ResultCache::ResultCache() {
+    header = nullptr;
+    entries = nullptr;
+    numSets = 0;
+    mappedSize = 0;
+    lookups = hits = stores = evictions = 0;
+}
+
+ResultCache::~ResultCache() {
+    close();
+}
+
+// Maps the cache file at path, creating it with room for MB megabytes of
+// entries if needed. A file of a different size or format is started over.
+bool ResultCache::open(const std::string &path, uint64_t MB) {
+    close();
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+#ifdef _WIN32
+    (void) path;
+    (void) MB;
+    cerr << "The result cache is not supported on this platform" << endl;
+    return false;
+#else
+    uint64_t numEntries = (MB << 20) / sizeof(CachedResult);
+    numEntries -= numEntries % RESULT_CACHE_WAYS;
+    if (numEntries == 0)
+        return false;
+    uint64_t size = sizeof(ResultCacheHeader) + numEntries * sizeof(CachedResult);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        cerr << "Could not open result cache " << path << endl;
+        return false;
+    }
+
+    struct stat fileInfo;
+    bool isNew = (fstat(fd, &fileInfo) != 0 || (uint64_t) fileInfo.st_size != size);
+    if (isNew && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t) size) != 0)) {
+        ::close(fd);
+        cerr << "Could not resize result cache " << path << endl;
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Could not map result cache " << path << endl;
+        return false;
+    }
+
+    header = (ResultCacheHeader *) mapping;
+    entries = (CachedResult *) ((char *) mapping + sizeof(ResultCacheHeader));
+    mappedSize = size;
+    numSets = numEntries / RESULT_CACHE_WAYS;
+
+    if (isNew || std::memcmp(header->magic, RESULT_CACHE_MAGIC, sizeof(RESULT_CACHE_MAGIC)) != 0
+     || header->version != RESULT_CACHE_VERSION || header->entrySize != sizeof(CachedResult)
+     || header->numEntries != numEntries) {
+        std::memset(mapping, 0, size);
+        std::memcpy(header->magic, RESULT_CACHE_MAGIC, sizeof(RESULT_CACHE_MAGIC));
+        header->version = RESULT_CACHE_VERSION;
+        header->entrySize = sizeof(CachedResult);
+        header->numEntries = numEntries;
+        header->clock = 0;
+    }
+
+    lookups = hits = stores = evictions = 0;
+    return true;
+#endif
+}
+
+void ResultCache::close() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (header == nullptr)
+        return;
+#ifndef _WIN32
+    msync(header, mappedSize, MS_ASYNC);
+    munmap(header, mappedSize);
+#endif
+    header = nullptr;
+    entries = nullptr;
+    numSets = 0;
+    mappedSize = 0;
+}
+
+// Looks up the result of an earlier search of the position with the same
+// limit. Entries are checked against the full key and limit.
+bool ResultCache::probe(uint64_t key, const TimeManagement &limit, SearchResult &result) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (header == nullptr)
+        return false;
+    lookups++;
+
+    CachedResult *set = getSet(key);
+    for (int i = 0; i < RESULT_CACHE_WAYS; i++) {
+        CachedResult *entry = &set[i];
+        if (entry->key != key || entry->pvLength == 0
+         || entry->searchMode != limit.searchMode || entry->allotment != limit.allotment)
+            continue;
+
+        entry->lastUsed = ++header->clock;
+        hits++;
+
+        result.clear();
+        result.score = entry->score;
+        result.depth = entry->depth;
+        result.pv.pvLength = entry->pvLength;
+        for (int j = 0; j < entry->pvLength; j++)
+            result.pv.pv[j] = entry->pv[j];
+        result.bestMove = entry->pv[0];
+        result.ponder = (entry->pvLength > 1) ? entry->pv[1] : NULL_MOVE;
+        return true;
+    }
+    return false;
+}
+
+// Saves a finished search, replacing an entry for the same position and limit,
+// an empty entry, or the least recently used entry of the set.
+void ResultCache::store(uint64_t key, const TimeManagement &limit, const SearchResult &result) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (header == nullptr || result.bestMove == NULL_MOVE || result.pv.pvLength == 0)
+        return;
+
+    CachedResult *set = getSet(key);
+    CachedResult *replace = &set[0];
+    for (int i = 0; i < RESULT_CACHE_WAYS; i++) {
+        CachedResult *entry = &set[i];
+        if ((entry->key == key && entry->searchMode == limit.searchMode
+          && entry->allotment == limit.allotment) || entry->pvLength == 0) {
+            replace = entry;
+            break;
+        }
+        if (entry->lastUsed < replace->lastUsed)
+            replace = entry;
+    }
+    if (replace->pvLength != 0 && replace->key != key)
+        evictions++;
+
+    replace->key = key;
+    replace->lastUsed = ++header->clock;
+    replace->allotment = limit.allotment;
+    replace->score = (int16_t) result.score;
+    replace->searchMode = (uint8_t) limit.searchMode;
+    replace->depth = (uint8_t) result.depth;
+    replace->pvLength = (uint8_t) std::min(result.pv.pvLength, RESULT_CACHE_PV_LENGTH);
+    for (int j = 0; j < replace->pvLength; j++)
+        replace->pv[j] = result.pv.pv[j];
+    stores++;
+}
+
+void ResultCache::printStatistics() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (header == nullptr) {
+        cerr << "Result cache is not open" << endl;
+        return;
+    }
+
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < header->numEntries; i++) {
+        if (entries[i].pvLength != 0)
+            used++;
+    }
+    cerr << "Entries   : " << used << " / " << header->numEntries << endl;
+    cerr << "Lookups   : " << lookups << endl;
+    cerr << "Hits      : " << hits;
+    if (lookups)
+        cerr << " (" << 100 * hits / lookups << "%)";
+    cerr << endl;
+    cerr << "Stores    : " << stores << endl;
+    cerr << "Evictions : " << evictions << endl;
+}
+
+CachedResult *ResultCache::getSet(uint64_t key) const {
+    return &entries[(key % numSets) * RESULT_CACHE_WAYS];
+}
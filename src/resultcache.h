@@ -0,0 +1,97 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RESULTCACHE_H__
+#define __RESULTCACHE_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "common.h"
+#include "search.h"
+#include "timeman.h"
+
+constexpr int RESULT_CACHE_PV_LENGTH = 24;
+// Entries per set; the least recently used entry of a set is replaced
+constexpr int RESULT_CACHE_WAYS = 8;
+constexpr uint32_t RESULT_CACHE_VERSION = 1;
+
+/**
+ * @brief One search result as stored in the cache file. The entry is only
+ * valid for the position's Zobrist key together with the search limit.
+ */
+struct CachedResult {
+    uint64_t key;
+    // Value of the cache clock when the entry was last stored or found
+    uint64_t lastUsed;
+    int32_t allotment;
+    int16_t score;
+    uint8_t searchMode;
+    uint8_t depth;
+    uint8_t pvLength;
+    uint8_t padding[5];
+    Move pv[RESULT_CACHE_PV_LENGTH];
+};
+
+struct ResultCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t numEntries;
+    uint64_t clock;
+};
+
+/**
+ * @brief A persistent, memory-mapped cache of finished search results, so
+ * that positions which are searched again with the same limit, such as
+ * popular openings, are answered without a search. The file is organized as
+ * sets of RESULT_CACHE_WAYS entries indexed by the Zobrist key, and lives on
+ * across engine restarts.
+ */
+class ResultCache {
+public:
+    ResultCache();
+    ResultCache(const ResultCache &other) = delete;
+    ResultCache& operator=(const ResultCache &other) = delete;
+    ~ResultCache();
+
+    bool open(const std::string &path, uint64_t MB);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    bool probe(uint64_t key, const TimeManagement &limit, SearchResult &result);
+    void store(uint64_t key, const TimeManagement &limit, const SearchResult &result);
+    void printStatistics();
+
+private:
+    ResultCacheHeader *header;
+    CachedResult *entries;
+    uint64_t numSets;
+    uint64_t mappedSize;
+    std::mutex cacheMutex;
+
+    // Statistics since the cache was opened
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stores;
+    uint64_t evictions;
+
+    CachedResult *getSet(uint64_t key) const;
+};
+
+#endif
@@ -24,24 +24,30 @@
 #include <mutex>
 #include <thread>
 #include <vector>
+#include "book.h"
 #include "eval.h"
 #include "hash.h"
+#include "instrument.h"
 #include "search.h"
 #include "moveorder.h"
+#include "output.h"
 #include "searchparams.h"
 #include "timeman.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
-using std::cout;
 using std::cerr;
-using std::endl;
 
 
-// Records search statistics required by the UCI protocol
+// Records search statistics required by the UCI protocol, and the cost of
+// tablebase probing in the search
 struct SearchStatistics {
     uint64_t nodes;
     uint64_t tbhits;
+    uint64_t wdlProbes;
+    uint64_t wdlCacheHits;
+    // Nanoseconds spent in probe_wdl
+    uint64_t wdlProbeTime;
 
     SearchStatistics() {
         reset();
@@ -50,16 +56,37 @@ struct SearchStatistics {
     void reset() {
         nodes = 0;
         tbhits = 0;
+        wdlProbes = 0;
+        wdlCacheHits = 0;
+        wdlProbeTime = 0;
     }
 };
 
-// Records the PV found by the search.
-struct SearchPV {
-    int pvLength;
-    Move pv[MAX_DEPTH+1];
+// Entries in each thread's cache of WDL probe results, a power of two
+constexpr int WDL_CACHE_SIZE = 4096;
+
+// Results of a thread's recent successful WDL probes, so that positions
+// reached again through transpositions are not decompressed again. The
+// cache is direct-mapped by Zobrist key.
+struct WDLProbeCache {
+    struct Entry {
+        uint64_t key;
+        int value;
+        bool isValid;
+    };
+    Entry entries[WDL_CACHE_SIZE];
+
+    WDLProbeCache() {
+        clear();
+    }
+
+    void clear() {
+        for (int i = 0; i < WDL_CACHE_SIZE; i++)
+            entries[i].isValid = false;
+    }
 
-    SearchPV() {
-        pvLength = 0;
+    Entry &get(uint64_t key) {
+        return entries[key & (WDL_CACHE_SIZE - 1)];
     }
 };
 
@@ -69,6 +96,7 @@ struct ThreadMemory {
     SearchStatistics searchStats;
     SearchStackInfo ssInfo[129];
     TwoFoldStack twoFoldPositions;
+    WDLProbeCache wdlCache;
 
     ThreadMemory() {
         for (int i = 0; i < 129; i++)
@@ -112,68 +140,162 @@ void initReductionTable() {
 
 
 //-----------------------------Global variables---------------------------------
-static Hash transpositionTable(DEFAULT_HASH_SIZE);
-static std::vector<ThreadMemory *> threadMemoryArray;
-
-// Variables for time management
-ChessTime startTime;
-uint64_t timeLimit;
-
-// Used to break out of the search thread if the stop command is given
-std::atomic<bool> isStop(true);
-// Additional stop signal to stop helper threads during SMP
-std::atomic<bool> stopSignal(true);
-
-// Dummy variables for lazy SMP since we don't care about these results
-int dummyBestIndex[MAX_THREADS-1];
-int dummyBestScore[MAX_THREADS-1];
-
-// Values for UCI options
-unsigned int multiPV;
-int numThreads;
-bool isPonderSearch = false;
-
 // Accessible from tbcore.c
 int TBlargest = 0;
-static int probeLimit = 0;
 
 
-// Search functions
-void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves,
-    int tbScore, bool tbProbeSuccess, int threadID);
-void getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, int alpha, int beta,
-    int *bestMoveIndex, int *bestScore, unsigned int startMove, int threadID, SearchPV *pvLine);
-int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode, SearchStackInfo *ssi, SearchPV *pvLine);
-int quiescence(Board &b, int plies, int alpha, int beta, int threadID);
-int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID);
-
 // Search helpers
 int scoreMate(bool isInCheck, int plies);
 int adjustHashScore(int score, int plies);
 
 // Other utility functions
+void filterSearchMoves(MoveList &legalMoves, const MoveList *movesToSearch);
 Move nextMove(MoveList &moves, ScoreList &scores, unsigned int index);
-uint64_t getTBHits();
 void changePV(Move best, SearchPV *parent, SearchPV *child);
-std::string retrievePV(SearchPV *pvLine);
-int getSelectiveDepth();
 double getPercentage(uint64_t numerator, uint64_t denominator);
 
 
+Search::Search(Hash *sharedTable)
+    : isStop(true), stopSignal(true),
+      ownTable(sharedTable == nullptr ? new Hash(DEFAULT_HASH_SIZE) : nullptr),
+      transpositionTable(sharedTable == nullptr ? *ownTable : *sharedTable) {
+    timeLimit = MAX_TIME;
+    nodeLimit = MAX_NODES;
+    multiPV = DEFAULT_MULTI_PV;
+    numThreads = 0;
+    isPonderSearch = false;
+    isSilent = false;
+    probeLimit = 0;
+    book = nullptr;
+    bookDepth = 0;
+    bookBestOnly = false;
+    setNumThreads(DEFAULT_THREADS);
+}
+
+Search::~Search() {
+    setNumThreads(0);
+    delete ownTable;
+}
+
+// Answers a timed search immediately, without starting the search threads,
+// when thinking cannot change the result: there is only one legal move, the
+// root is resolved by the DTZ tables, or there is almost no time left on the
+// clock, in which case the hash move is played. Returns true if a bestmove was
+// sent.
+bool Search::playInstantMove(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch) {
+    // Pondering and fixed depth/movetime searches must run as requested
+    if (timeParams->searchMode != TIME || isPonderSearch)
+        return false;
+
+    const int color = b->getPlayerToMove();
+    MoveList legalMoves = b->getAllLegalMoves(color);
+    filterSearchMoves(legalMoves, movesToSearch);
+    // Mates and stalemates are reported by getBestMoveThreader
+    if (legalMoves.size() == 0)
+        return false;
+
+    Move instantMove = NULL_MOVE;
+    const char *reason = "";
+
+    if (legalMoves.size() == 1) {
+        instantMove = legalMoves.get(0);
+        reason = "only legal move";
+    }
+
+    // A decisive DTZ result already tells us the fastest win or the longest
+    // resistance. Drawn positions are still searched to keep swindling chances.
+    if (instantMove == NULL_MOVE && TBlargest
+     && count(b->getAllPieces(WHITE) | b->getAllPieces(BLACK)) <= TBlargest) {
+        MoveList tbMoves = legalMoves;
+        ScoreList scores;
+        int tbScore = 0;
+        if (root_probe(b, &threadMemoryArray[0]->twoFoldPositions, tbMoves, scores, tbScore) && tbScore != 0 && tbMoves.size() > 0) {
+            // Wins are scored as the DTZ and losses as minus the DTZ, so the
+            // lowest score is the fastest win or the slowest loss
+            unsigned int best = 0;
+            for (unsigned int i = 1; i < tbMoves.size(); i++) {
+                if (scores.get(i) < scores.get(best))
+                    best = i;
+            }
+            instantMove = tbMoves.get(best);
+            reason = (tbScore > 0) ? "tablebase win" : "tablebase loss";
+        }
+    }
+
+    // Searching with next to no time risks losing on time or returning an
+    // unsorted move from an incomplete first iteration, so trust the hash move.
+    if (instantMove == NULL_MOVE && timeParams->maxAllotment < INSTANT_MOVE_TIME) {
+        Move hashed = getLegalHashMove(*b);
+        for (unsigned int i = 0; i < legalMoves.size(); i++) {
+            if (legalMoves.get(i) == hashed) {
+                instantMove = hashed;
+                reason = "low time, hash move";
+            }
+        }
+    }
+
+    if (instantMove == NULL_MOVE)
+        return false;
+
+    sendInstantMove(b, instantMove, reason);
+    return true;
+}
+
+// Reports a move chosen without searching as the result of the search, with
+// the hash move of the resulting position as the ponder move
+void Search::sendInstantMove(const Board *b, Move m, const char *reason) {
+    Board copy = b->staticCopy();
+    copy.doMove(m, b->getPlayerToMove());
+    Move ponder = getLegalHashMove(copy);
+
+    result.clear();
+    result.bestMove = m;
+    result.ponder = ponder;
+
+    if (!isSilent) {
+        OutputLine() << "info string instant move: " << reason;
+        if (ponder != NULL_MOVE)
+            OutputLine() << "bestmove " << moveToString(m) << " ponder " << moveToString(ponder);
+        else
+            OutputLine() << "bestmove " << moveToString(m);
+    }
+
+    stopSignal = true;
+    isStop = true;
+}
+
 // Spawns the appropriate number of getBestMove threads and cleans up the helpers
 // when the main thread is done.
-void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch) {
+void Search::getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch) {
     const int color = b->getPlayerToMove();
     MoveList legalMoves = b->getAllLegalMoves(color);
+    result.clear();
 
     // Special case if we are given a mate/stalemate position
     if (legalMoves.size() <= 0) {
         stopSignal = true;
         isStop = true;
-        cout << "bestmove none" << endl;
+        result.score = b->isInCheck(color) ? -MATE_SCORE : 0;
+        if (!isSilent)
+            OutputLine() << "bestmove none";
         return;
     }
 
+    // Book moves are played at once in games, but not when pondering or
+    // analyzing
+    if (book != nullptr && !isPonderSearch && b->getMoveNumber() <= bookDepth
+     && (timeParams->searchMode == TIME || timeParams->searchMode == MOVETIME)) {
+        Move bookMove = book->probe(*b, bookBestOnly);
+        MoveList bookMoves;
+        if (bookMove != NULL_MOVE)
+            bookMoves.add(bookMove);
+        filterSearchMoves(bookMoves, movesToSearch);
+        if (bookMoves.size() > 0) {
+            sendInstantMove(b, bookMoves.get(0), "book move");
+            return;
+        }
+    }
+
     // Reset all search parameters (killers, plies, etc)
     for (int i = 0; i < numThreads; i++) {
         threadMemoryArray[i]->searchParams.reset();
@@ -194,7 +316,7 @@ void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *m
     if (TBlargest && count(b->getAllPieces(WHITE) | b->getAllPieces(BLACK)) <= TBlargest) {
         ScoreList scores;
         // Try probing with DTZ tables first
-        int tbProbeResult = root_probe(b, legalMoves, scores, tbScore);
+        int tbProbeResult = root_probe(b, &threadMemoryArray[0]->twoFoldPositions, legalMoves, scores, tbScore);
         if (tbProbeResult) {
             // With DTZ table filtering, we have guaranteed that we will not
             // make a mistake so do not probe TBs in search
@@ -219,22 +341,14 @@ void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *m
 
 
     // If we were told to search specific moves, filter them here
-    if (movesToSearch->size() > 0) {
-        MoveList temp;
-        for (unsigned int i = 0; i < legalMoves.size(); i++) {
-            for (unsigned int j = 0; j < movesToSearch->size(); j++) {
-                if (legalMoves.get(i) == movesToSearch->get(j))
-                    temp.add(legalMoves.get(i));
-            }
-        }
-        legalMoves = temp;
-    }
+    filterSearchMoves(legalMoves, movesToSearch);
 
 
     // Set up timing
     timeLimit = (timeParams->searchMode == TIME) ? timeParams->maxAllotment
                                                  : (timeParams->searchMode == MOVETIME) ? timeParams->allotment
                                                                                         : MAX_TIME;
+    nodeLimit = (timeParams->searchMode == NODES) ? (uint64_t) timeParams->allotment : MAX_NODES;
     startTime = ChessClock::now();
 
     // Special case if there is only one legal move: use less search time,
@@ -243,8 +357,16 @@ void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *m
         timeLimit = std::min(timeLimit / 32, ONE_SECOND);
     }
 
-    // Increment hash table age
-    transpositionTable.incrementAge();
+    // If the game followed the PV of our last search, start from its results
+    int startDepth = 1;
+    int startScore = -INFTY;
+    if (!tbProbeSuccess)
+        continuePreviousSearch(b, timeParams, legalMoves, startDepth, startScore);
+
+    // Increment hash table age. A borrowed table is shared with other
+    // searches, so its owner ages it once per job instead.
+    if (ownTable != nullptr)
+        transpositionTable.incrementAge();
 
 
     // Create threads for SMP if necessary
@@ -253,7 +375,8 @@ void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *m
 
         // Start and join all threads
         for (int i = 0; i < numThreads; i++) {
-            threadPool[i] = std::thread(getBestMove, b, timeParams, legalMoves, tbScore, tbProbeSuccess, i);
+            threadPool[i] = std::thread(&Search::getBestMove, this, b, timeParams, legalMoves, tbScore, tbProbeSuccess,
+                startDepth, startScore, i);
         }
         for (int i = 0; i < numThreads; i++) {
             threadPool[i].join();
@@ -264,19 +387,26 @@ void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *m
     }
     // Otherwise, just search with one thread
     else {
-        getBestMove(b, timeParams, legalMoves, tbScore, tbProbeSuccess, 0);
+        getBestMove(b, timeParams, legalMoves, tbScore, tbProbeSuccess, startDepth, startScore, 0);
     }
 }
 
 // Finds a best move for a position according to the given search parameters.
-void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves,
-        int tbScore, bool tbProbeSuccess, int threadID) {
+void Search::getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves,
+        int tbScore, bool tbProbeSuccess, int startDepth, int startScore, int threadID) {
     Move ponder = NULL_MOVE;
     Move bestMove = legalMoves.get(0);
-    uint64_t timeSoFar;
-
-    int bestScore = -INFTY, bestMoveIndex = -1;
-    int rootDepth = 1;
+    uint64_t timeSoFar = 0;
+
+    int bestScore = startScore, bestMoveIndex = -1;
+    int rootDepth = startDepth;
+    // The PV, score, and depth of the last completed iteration
+    SearchPV completedPV;
+    int completedScore = -INFTY;
+    int completedDepth = 0;
+    int bestMoveChanges = 0;
+    int lastChangeDepth = 0;
+    int scoreChange = 0;
     Move prevBest = NULL_MOVE;
     int prevScore = -INFTY;
     int pvStreak = 0;
@@ -328,17 +458,18 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
                 // Handle fail highs and fail lows
                 // Fail low: no best move found
                 if (bestMoveIndex == -1 && !isStop) {
-                    if (threadID == 0) {
-                        cout << "info depth " << rootDepth;
-                        cout << " seldepth " << getSelectiveDepth();
-                        cout << " score";
-                        cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS]
+                    if (threadID == 0 && !isSilent) {
+                        OutputLine info;
+                        info << "info depth " << rootDepth;
+                        info << " seldepth " << getSelectiveDepth();
+                        info << " score";
+                        info << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS]
                              << " upperbound";
-                        cout << " time " << timeSoFar
+                        info << " time " << timeSoFar
                              << " nodes " << getNodes() << " nps " << nps
                              << " tbhits " << getTBHits()
                              << " hashfull " << transpositionTable.estimateHashfull()
-                             << " pv " << retrievePV(&pvLine) << endl;
+                             << " pv " << retrievePV(&pvLine);
                     }
 
                     aspBeta = (aspAlpha + aspBeta) / 2;
@@ -350,17 +481,18 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
                 }
                 // Fail high: best score is at least beta
                 else if (bestScore >= aspBeta) {
-                    if (threadID == 0) {
-                        cout << "info depth " << rootDepth;
-                        cout << " seldepth " << getSelectiveDepth();
-                        cout << " score";
-                        cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS]
+                    if (threadID == 0 && !isSilent) {
+                        OutputLine info;
+                        info << "info depth " << rootDepth;
+                        info << " seldepth " << getSelectiveDepth();
+                        info << " score";
+                        info << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS]
                              << " lowerbound";
-                        cout << " time " << timeSoFar
+                        info << " time " << timeSoFar
                              << " nodes " << getNodes() << " nps " << nps
                              << " tbhits " << getTBHits()
                              << " hashfull " << transpositionTable.estimateHashfull()
-                             << " pv " << retrievePV(&pvLine) << endl;
+                             << " pv " << retrievePV(&pvLine);
                     }
 
                     aspAlpha = (aspAlpha + aspBeta) / 2;
@@ -392,14 +524,14 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
 
             // If we broke out before getting any new results, end the search
             if (bestMoveIndex == -1) {
-                if (threadID == 0) {
-                    cout << "info depth " << rootDepth-1;
-                    cout << " seldepth " << getSelectiveDepth();
-                    cout << " time " << timeSoFar
+                if (threadID == 0 && !isSilent) {
+                    OutputLine info;
+                    info << "info depth " << rootDepth-1;
+                    info << " seldepth " << getSelectiveDepth();
+                    info << " time " << timeSoFar
                          << " nodes " << getNodes() << " nps " << nps
                          << " tbhits " << getTBHits()
-                         << " hashfull " << transpositionTable.estimateHashfull()
-                         << endl;
+                         << " hashfull " << transpositionTable.estimateHashfull();
                 }
                 break;
             }
@@ -444,32 +576,61 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
                 nextMove(legalMoves, scores, i);
             }
 
+            if (multiPVNum == 1) {
+                if (completedDepth > 0) {
+                    if (bestMove != completedPV.pv[0]) {
+                        bestMoveChanges++;
+                        lastChangeDepth = rootDepth;
+                    }
+                    scoreChange = abs(bestScore - completedScore);
+                }
+                completedPV = pvLine;
+                completedScore = bestScore;
+                completedDepth = rootDepth;
+
+                if (threadID == 0 && iterationCallback) {
+                    SearchResult progress;
+                    progress.bestMove = bestMove;
+                    progress.ponder = ponder;
+                    progress.score = bestScore;
+                    progress.depth = rootDepth;
+                    progress.pv = pvLine;
+                    progress.nodes = getNodes();
+                    progress.time = timeSoFar;
+                    progress.bestMoveChanges = bestMoveChanges;
+                    progress.lastChangeDepth = lastChangeDepth;
+                    progress.scoreChange = scoreChange;
+                    iterationCallback(progress);
+                }
+            }
+
             // Output info using UCI protocol
-            if (threadID == 0) {
-                cout << "info depth " << rootDepth;
-                cout << " seldepth " << getSelectiveDepth();
+            if (threadID == 0 && !isSilent) {
+                OutputLine info;
+                info << "info depth " << rootDepth;
+                info << " seldepth " << getSelectiveDepth();
                 if (multiPV > 1)
-                    cout << " multipv " << multiPVNum;
-                cout << " score";
+                    info << " multipv " << multiPVNum;
+                info << " score";
 
                 // Print score in mate or centipawns
                 if (bestScore >= MAX_PLY_MATE_SCORE)
                     // If it is our mate, it takes plies / 2 + 1 moves to mate since
                     // our move ends the game
-                    cout << " mate " << (MATE_SCORE - bestScore) / 2 + 1;
+                    info << " mate " << (MATE_SCORE - bestScore) / 2 + 1;
                 else if (bestScore <= -MAX_PLY_MATE_SCORE)
                     // If we are being mated, it takes plies / 2 moves since our
                     // opponent's move ends the game
-                    cout << " mate " << (-MATE_SCORE - bestScore) / 2;
+                    info << " mate " << (-MATE_SCORE - bestScore) / 2;
                 else
                     // Scale score into centipawns using our internal pawn value
-                    cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS];
+                    info << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS];
 
-                cout << " time " << timeSoFar
+                info << " time " << timeSoFar
                      << " nodes " << getNodes() << " nps " << nps
                      << " tbhits " << getTBHits()
                      << " hashfull " << transpositionTable.estimateHashfull()
-                     << " pv " << retrievePV(&pvLine) << endl;
+                     << " pv " << retrievePV(&pvLine);
             }
         }
         // End multiPV loop
@@ -524,6 +685,7 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
           || ((((timeParams->searchMode == TIME && timeSoFar < (uint64_t) timeParams->allotment * TIME_FACTOR * timeChangeFactor)
               || isPonderSearch) && rootDepth <= MAX_DEPTH)
            || (timeParams->searchMode == MOVETIME && timeSoFar < (uint64_t) timeParams->allotment && rootDepth <= MAX_DEPTH)
+           || (timeParams->searchMode == NODES && getNodes() < nodeLimit && rootDepth <= MAX_DEPTH)
            || (timeParams->searchMode == DEPTH && rootDepth <= timeParams->allotment))));
 
     // When pondering, we must continue "searching" until given a stop or ponderhit command.
@@ -535,15 +697,37 @@ void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves
         stopSignal = true;
         isStop = true;
 
+        rememberSearch(b, &completedPV, completedScore, completedDepth);
+
+        result.bestMove = bestMove;
+        result.ponder = ponder;
+        result.score = completedScore;
+        result.depth = completedDepth;
+        result.pv = completedPV;
+        // A search stopped during its first iteration has only the move
+        if (result.pv.pvLength == 0) {
+            result.pv.pv[0] = bestMove;
+            result.pv.pvLength = 1;
+            result.score = 0;
+        }
+        result.nodes = getNodes();
+        result.time = getTimeElapsed(startTime);
+        result.bestMoveChanges = bestMoveChanges;
+        result.lastChangeDepth = lastChangeDepth;
+        result.scoreChange = scoreChange;
+
+        if (isSilent)
+            return;
+        printTBStatistics();
         if (ponder != NULL_MOVE)
-            cout << "bestmove " << moveToString(bestMove) << " ponder " << moveToString(ponder) << endl;
+            OutputLine() << "bestmove " << moveToString(bestMove) << " ponder " << moveToString(ponder);
         else
-            cout << "bestmove " << moveToString(bestMove) << endl;
+            OutputLine() << "bestmove " << moveToString(bestMove);
     }
 }
 
 // Returns the index of the best move in legalMoves
-void getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, int alpha,
+void Search::getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, int alpha,
         int beta, int *bestMoveIndex, int *bestScore, unsigned int startMove,
         int threadID, SearchPV *pvLine) {
     SearchParameters *searchParams = &(threadMemoryArray[threadID]->searchParams);
@@ -569,9 +753,9 @@ void getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, i
         // search have elapsed to avoid clutter
         uint64_t timeSoFar = getTimeElapsed(startTime);
         uint64_t nps = 1000 * getNodes() / timeSoFar;
-        if (threadID == 0 && timeSoFar > 5 * ONE_SECOND)
-            cout << "info depth " << depth << " currmove " << moveToString(m)
-                 << " currmovenumber " << i+1 << " nodes " << getNodes() << " nps " << nps << endl;
+        if (threadID == 0 && !isSilent && timeSoFar > 5 * ONE_SECOND)
+            OutputLine() << "info depth " << depth << " currmove " << moveToString(m)
+                         << " currmovenumber " << i+1 << " nodes " << getNodes() << " nps " << nps;
 
         Board copy = b->staticCopy();
         copy.doMove(m, color);
@@ -643,7 +827,8 @@ void getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, i
 //------------------------------Search functions--------------------------------
 //------------------------------------------------------------------------------
 // The standard implementation of a fail-soft PVS search.
-int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode, SearchStackInfo *ssi, SearchPV *pvLine) {
+int Search::PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode, SearchStackInfo *ssi, SearchPV *pvLine) {
+    INSTRUMENT_SCOPE(IC_PVS);
     SearchParameters *searchParams = &(threadMemoryArray[threadID]->searchParams);
     SearchStatistics *searchStats = &(threadMemoryArray[threadID]->searchStats);
     // Reset the PV line
@@ -684,7 +869,7 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
     // Check for a timeout
     if (threadID == 0 && (searchStats->nodes & 1023) == 1023 && !isPonderSearch) {
         uint64_t timeSoFar = getTimeElapsed(startTime);
-        if (timeSoFar > timeLimit) {
+        if (timeSoFar > timeLimit || getNodes() >= nodeLimit) {
             isStop = true;
             stopSignal = true;
         }
@@ -752,8 +937,26 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
      && count(b.getAllPieces(WHITE) | b.getAllPieces(BLACK)) <= probeLimit
      && b.getFiftyMoveCounter() == 0
      && !b.getAnyCanCastle()) {
-        int tbProbeResult;
-        int tbValue = probe_wdl(b, &tbProbeResult);
+        uint64_t key = b.getZobristKey();
+        WDLProbeCache::Entry &cached = threadMemoryArray[threadID]->wdlCache.get(key);
+        int tbProbeResult = 1;
+        int tbValue;
+        searchStats->wdlProbes++;
+        if (cached.isValid && cached.key == key) {
+            tbValue = cached.value;
+            searchStats->wdlCacheHits++;
+        }
+        else {
+            auto probeStart = ChessClock::now();
+            tbValue = probe_wdl(b, &tbProbeResult);
+            searchStats->wdlProbeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                ChessClock::now() - probeStart).count();
+            if (tbProbeResult != 0) {
+                cached.key = key;
+                cached.value = tbValue;
+                cached.isValid = true;
+            }
+        }
 
         // Probe was successful
         if (tbProbeResult != 0) {
@@ -1012,6 +1215,11 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
             continue;
 
 
+        // Start loading the child's hash entry while the move is made. The
+        // hash move may not be valid, so its key is not computed here.
+        if (m != hashed)
+            transpositionTable.prefetch(b.getZobristKeyAfter(m, color));
+
         // Copy the board and do the move
         Board copy = b.staticCopy();
         // If we are searching the hash move, we must use to a special
@@ -1226,7 +1434,8 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
  * spent here.
  * The search is a fail-soft PVS.
  */
-int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
+int Search::quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
+    INSTRUMENT_SCOPE(IC_QUIESCENCE);
     SearchParameters *searchParams = &(threadMemoryArray[threadID]->searchParams);
     SearchStatistics *searchStats = &(threadMemoryArray[threadID]->searchStats);
     int color = b.getPlayerToMove();
@@ -1330,6 +1539,7 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
         if (!b.isSEEAbove(color, m, 0))
             continue;
 
+        transpositionTable.prefetch(b.getZobristKeyAfter(m, color));
         Board copy = b.staticCopy();
         if (!copy.doPseudoLegalMove(m, color))
             continue;
@@ -1357,7 +1567,8 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
  * When checks are considered in quiescence, the responses must include all moves,
  * not just captures, necessitating this function.
  */
-int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID) {
+int Search::checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID) {
+    INSTRUMENT_SCOPE(IC_CHECK_QUIESCENCE);
     if (b.getFiftyMoveCounter() >= 2 && threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey()))
         return 0;
 
@@ -1413,6 +1624,67 @@ int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID) {
 //-----------------------------Search Helpers-----------------------------------
 //------------------------------------------------------------------------------
 
+// If the position is the one our last search expected after its best move and
+// the predicted reply, or the one given to resumeSearch(), seeds this search
+// from it: the next PV move is searched
+// first, the first iteration starts a few plies short of the depth the PV was
+// searched to (those iterations are mostly hash hits anyway), and its
+// aspiration window is centered on the previous score.
+void Search::continuePreviousSearch(const Board *b, TimeManagement *timeParams, MoveList &legalMoves,
+        int &startDepth, int &startScore) {
+    if (previousSearch.pv.pvLength == 0 || previousSearch.expectedKey != b->getZobristKey())
+        return;
+
+    for (unsigned int i = 0; i < legalMoves.size(); i++) {
+        if (legalMoves.get(i) == previousSearch.pv.pv[0]) {
+            legalMoves.swap(0, i);
+            break;
+        }
+    }
+
+    // Any mate is now closer by the plies played since
+    startScore = adjustHashScore(previousSearch.score, previousSearch.plies);
+    startDepth = std::max(1, previousSearch.depth - previousSearch.plies - CARRYOVER_DEPTH_MARGIN);
+    if (timeParams->searchMode == DEPTH)
+        startDepth = std::min(startDepth, timeParams->allotment);
+
+    previousSearch.clear();
+}
+
+// Records the final PV of a search for continuePreviousSearch().
+void Search::rememberSearch(const Board *b, SearchPV *pvLine, int score, int depth) {
+    previousSearch.clear();
+    // We need our move, the expected reply, and our next move
+    if (pvLine->pvLength < 3 || depth < 3)
+        return;
+
+    Board copy = b->staticCopy();
+    copy.doMove(pvLine->pv[0], copy.getPlayerToMove());
+    copy.doMove(pvLine->pv[1], copy.getPlayerToMove());
+
+    previousSearch.expectedKey = copy.getZobristKey();
+    previousSearch.pv.pvLength = pvLine->pvLength - 2;
+    for (int i = 0; i < previousSearch.pv.pvLength; i++)
+        previousSearch.pv.pv[i] = pvLine->pv[i+2];
+    previousSearch.score = score;
+    previousSearch.depth = depth;
+    previousSearch.plies = 2;
+}
+
+// Lets the next search of b continue from an earlier search of the same
+// position, e.g. when a tool gives a position more nodes in a later round.
+// The earlier search should have used this instance's hash table.
+void Search::resumeSearch(const Board *b, const SearchResult &earlier) {
+    previousSearch.clear();
+    if (earlier.pv.pvLength == 0)
+        return;
+    previousSearch.expectedKey = b->getZobristKey();
+    previousSearch.pv = earlier.pv;
+    previousSearch.score = earlier.score;
+    previousSearch.depth = earlier.depth;
+    previousSearch.plies = 0;
+}
+
 // Used to get a score when we have realized that we have no legal moves.
 int scoreMate(bool isInCheck, int plies) {
     // If we are in check, then it is a checkmate
@@ -1436,11 +1708,11 @@ int adjustHashScore(int score, int plies) {
 
 
 // Pondering
-void startPonder() {
+void Search::startPonder() {
     isPonderSearch = true;
 }
 
-void stopPonder() {
+void Search::stopPonder() {
     isPonderSearch = false;
 }
 
@@ -1450,17 +1722,27 @@ void stopPonder() {
 //------------------------------------------------------------------------------
 
 // These functions help to communicate with uci.cpp
-void clearTables() {
+void Search::clearTables() {
     transpositionTable.clear();
-    for (int i = 0; i < numThreads; i++)
+    clearSearchState();
+}
+
+// Resets everything a search learns except the transposition table, which
+// may be shared with other searches
+void Search::clearSearchState() {
+    previousSearch.clear();
+    for (int i = 0; i < numThreads; i++) {
         threadMemoryArray[i]->searchParams.resetHistoryTable();
+        threadMemoryArray[i]->wdlCache.clear();
+    }
 }
 
-void setHashSize(uint64_t MB) {
+void Search::setHashSize(uint64_t MB) {
     transpositionTable.setSize(MB);
+    previousSearch.clear();
 }
 
-uint64_t getNodes() {
+uint64_t Search::getNodes() const {
     uint64_t total = 0;
     for (int i = 0; i < numThreads; i++) {
         total += threadMemoryArray[i]->searchStats.nodes;
@@ -1468,7 +1750,7 @@ uint64_t getNodes() {
     return total;
 }
 
-uint64_t getTBHits() {
+uint64_t Search::getTBHits() const {
     uint64_t total = 0;
     for (int i = 0; i < numThreads; i++) {
         total += threadMemoryArray[i]->searchStats.tbhits;
@@ -1476,11 +1758,33 @@ uint64_t getTBHits() {
     return total;
 }
 
-void setMultiPV(unsigned int n) {
+// Reports the WDL probes of the last search, if there were any: how many
+// positions were probed, how many of them were answered by the per-thread
+// caches, and the time spent in the tables
+void Search::printTBStatistics() const {
+    uint64_t probes = 0, cacheHits = 0, probeTime = 0;
+    for (int i = 0; i < numThreads; i++) {
+        probes += threadMemoryArray[i]->searchStats.wdlProbes;
+        cacheHits += threadMemoryArray[i]->searchStats.wdlCacheHits;
+        probeTime += threadMemoryArray[i]->searchStats.wdlProbeTime;
+    }
+    if (probes == 0)
+        return;
+
+    OutputLine() << "info string wdl probes " << probes << " cache hits " << cacheHits
+                 << " (" << (int) getPercentage(cacheHits, probes) << "%) probe time "
+                 << probeTime / 1000000 << " ms";
+}
+
+unsigned int Search::getMultiPV() const {
+    return multiPV;
+}
+
+void Search::setMultiPV(unsigned int n) {
     multiPV = n;
 }
 
-void setNumThreads(int n) {
+void Search::setNumThreads(int n) {
     numThreads = n;
 
     while ((int) threadMemoryArray.size() < n)
@@ -1491,15 +1795,62 @@ void setNumThreads(int n) {
     }
 }
 
-void initPerThreadMemory() {
-    threadMemoryArray.push_back(new ThreadMemory());
+void Search::setSilent(bool silent) {
+    isSilent = silent;
+}
+
+void Search::setIterationCallback(IterationCallback callback) {
+    iterationCallback = callback;
 }
 
-TwoFoldStack *getTwoFoldStackPointer() {
+// Plays moves from the book, if it is not null, until the given move number
+void Search::setBook(PolyglotBook *_book, int depth, bool bestOnly) {
+    book = _book;
+    bookDepth = depth;
+    bookBestOnly = bestOnly;
+}
+
+const SearchResult &Search::getResult() const {
+    return result;
+}
+
+TwoFoldStack *Search::getTwoFoldStackPointer() {
     return &(threadMemoryArray[0]->twoFoldPositions);
 }
 
 
+// Restricts the root moves to those given with "go searchmoves", if any
+void filterSearchMoves(MoveList &legalMoves, const MoveList *movesToSearch) {
+    if (movesToSearch->size() == 0)
+        return;
+
+    MoveList temp;
+    for (unsigned int i = 0; i < legalMoves.size(); i++) {
+        for (unsigned int j = 0; j < movesToSearch->size(); j++) {
+            if (legalMoves.get(i) == movesToSearch->get(j))
+                temp.add(legalMoves.get(i));
+        }
+    }
+    legalMoves = temp;
+}
+
+// Returns the hash move for a position if it is legal there, and NULL_MOVE
+// otherwise. The legality check guards against key collisions.
+Move Search::getLegalHashMove(const Board &b) {
+    Board copy = b.staticCopy();
+    HashEntry *entry = transpositionTable.get(copy);
+    if (entry == nullptr || entry->move == NULL_MOVE)
+        return NULL_MOVE;
+
+    Move hashed = entry->move;
+    MoveList legalMoves = b.getAllLegalMoves(b.getPlayerToMove());
+    for (unsigned int i = 0; i < legalMoves.size(); i++) {
+        if (legalMoves.get(i) == hashed)
+            return hashed;
+    }
+    return NULL_MOVE;
+}
+
 // Retrieves the next move with the highest score, starting from index using a
 // partial selection sort. This way, the entire list does not have to be sorted
 // if an early cutoff occurs.
@@ -1531,7 +1882,7 @@ void changePV(Move best, SearchPV *parent, SearchPV *child) {
 }
 
 // Recover PV for outputting to terminal / GUI
-std::string retrievePV(SearchPV *pvLine) {
+std::string retrievePV(const SearchPV *pvLine) {
     std::string pvStr = moveToString(pvLine->pv[0]);
     for (int i = 1; i < pvLine->pvLength; i++) {
         pvStr += " " + moveToString(pvLine->pv[i]);
@@ -1540,9 +1891,18 @@ std::string retrievePV(SearchPV *pvLine) {
     return pvStr;
 }
 
+// Formats a score the way UCI info lines do, as "cp <x>" or "mate <n>"
+std::string scoreToString(int score) {
+    if (score >= MAX_PLY_MATE_SCORE)
+        return "mate " + std::to_string((MATE_SCORE - score) / 2 + 1);
+    if (score <= -MAX_PLY_MATE_SCORE)
+        return "mate " + std::to_string((-MATE_SCORE - score) / 2);
+    return "cp " + std::to_string(score * 100 / PIECE_VALUES[EG][PAWNS]);
+}
+
 // The selective depth in a parallel search is the max selective depth reached
 // by any of the threads
-int getSelectiveDepth() {
+int Search::getSelectiveDepth() const {
     int max = 0;
     for (int i = 0; i < numThreads; i++)
         if (threadMemoryArray[i]->searchParams.selectiveDepth > max)
@@ -19,8 +19,13 @@
 #ifndef __SEARCH_H__
 #define __SEARCH_H__
 
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
 #include "board.h"
 #include "common.h"
+#include "hash.h"
 #include "timeman.h"
 
 /*
@@ -88,26 +93,181 @@ struct SearchStackInfo {
     int **followupMoveHistory;
 };
 
-void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch);
-void clearTables();
-void setHashSize(uint64_t MB);
-uint64_t getNodes();
-void setMultiPV(unsigned int n);
-void setNumThreads(int n);
-void initPerThreadMemory();
-void initReductionTable();
-TwoFoldStack *getTwoFoldStackPointer();
+// Records the PV found by the search.
+struct SearchPV {
+    int pvLength;
+    Move pv[MAX_DEPTH+1];
+
+    SearchPV() {
+        pvLength = 0;
+    }
+};
+
+// Remembers the outcome of the last search, so that the next search of the
+// same game can pick up where it left off if the game followed the PV.
+struct PreviousSearch {
+    // Zobrist key of the position after our best move and the expected reply
+    uint64_t expectedKey;
+    // The rest of the PV from that position on
+    SearchPV pv;
+    int score;
+    int depth;
+    // Plies from the root of the remembered search to the expected position:
+    // 2 in a game, or 0 when the same position is searched again
+    int plies;
+
+    PreviousSearch() {
+        clear();
+    }
+
+    void clear() {
+        expectedKey = 0;
+        pv.pvLength = 0;
+        score = -INFTY;
+        depth = 0;
+        plies = 0;
+    }
+};
+
+// The outcome of a finished search, for callers that do not read UCI output
+struct SearchResult {
+    Move bestMove;
+    Move ponder;
+    // The score of the last completed iteration, in internal units
+    int score;
+    int depth;
+    SearchPV pv;
+    uint64_t nodes;
+    uint64_t time;
+    // How stable the search was across iterations: the number of times the
+    // best move changed, the depth of the last change, and the score change
+    // between the last two completed iterations
+    int bestMoveChanges;
+    int lastChangeDepth;
+    int scoreChange;
+
+    SearchResult() {
+        clear();
+    }
+
+    void clear() {
+        bestMove = NULL_MOVE;
+        ponder = NULL_MOVE;
+        score = 0;
+        depth = 0;
+        pv.pvLength = 0;
+        nodes = 0;
+        time = 0;
+        bestMoveChanges = 0;
+        lastChangeDepth = 0;
+        scoreChange = 0;
+    }
+};
 
-// Pondering
-void startPonder();
-void stopPonder();
+// Receives the state of a search after each completed iteration
+typedef std::function<void(const SearchResult &)> IterationCallback;
+
+struct ThreadMemory;
+class PolyglotBook;
+
+/**
+ * @brief Everything one search needs: the transposition table, per-thread
+ * memory, limits, and stop signals. The UCI loop owns one instance; tools can
+ * run several independent instances side by side, optionally sharing a
+ * transposition table.
+ */
+class Search {
+public:
+    // Used to break out of the search thread if the stop command is given
+    std::atomic<bool> isStop;
+    // Additional stop signal to stop helper threads during SMP
+    std::atomic<bool> stopSignal;
+
+    Search(Hash *sharedTable = nullptr);
+    Search(const Search &other) = delete;
+    Search& operator=(const Search &other) = delete;
+    ~Search();
+
+    bool playInstantMove(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch);
+    void getBestMoveThreader(const Board *b, TimeManagement *timeParams, MoveList *movesToSearch);
+    const SearchResult &getResult() const;
+    void resumeSearch(const Board *b, const SearchResult &earlier);
+
+    void clearTables();
+    void clearSearchState();
+    void setHashSize(uint64_t MB);
+    uint64_t getNodes() const;
+    unsigned int getMultiPV() const;
+    void setMultiPV(unsigned int n);
+    void setNumThreads(int n);
+    void setSilent(bool silent);
+    void setIterationCallback(IterationCallback callback);
+    void setBook(PolyglotBook *_book, int depth, bool bestOnly);
+    TwoFoldStack *getTwoFoldStackPointer();
+
+    // Pondering
+    void startPonder();
+    void stopPonder();
+
+private:
+    Hash *ownTable;
+    Hash &transpositionTable;
+    std::vector<ThreadMemory *> threadMemoryArray;
+    PreviousSearch previousSearch;
+    SearchResult result;
+
+    // Variables for time management
+    ChessTime startTime;
+    uint64_t timeLimit;
+    uint64_t nodeLimit;
+
+    // Values for UCI options
+    unsigned int multiPV;
+    int numThreads;
+    bool isPonderSearch;
+    // Searches run by tools print nothing and only fill in the result
+    bool isSilent;
+    IterationCallback iterationCallback;
+    int probeLimit;
+    // Opening book, played until the given move number
+    PolyglotBook *book;
+    int bookDepth;
+    bool bookBestOnly;
+
+    // Search functions
+    void getBestMove(const Board *b, TimeManagement *timeParams, MoveList legalMoves,
+        int tbScore, bool tbProbeSuccess, int startDepth, int startScore, int threadID);
+    void getBestMoveAtDepth(const Board *b, const MoveList *legalMoves, int depth, int alpha, int beta,
+        int *bestMoveIndex, int *bestScore, unsigned int startMove, int threadID, SearchPV *pvLine);
+    int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode, SearchStackInfo *ssi, SearchPV *pvLine);
+    int quiescence(Board &b, int plies, int alpha, int beta, int threadID);
+    int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID);
+
+    // Search helpers
+    void continuePreviousSearch(const Board *b, TimeManagement *timeParams, MoveList &legalMoves,
+        int &startDepth, int &startScore);
+    void rememberSearch(const Board *b, SearchPV *pvLine, int score, int depth);
+    Move getLegalHashMove(const Board &b);
+    void sendInstantMove(const Board *b, Move m, const char *reason);
+    uint64_t getTBHits() const;
+    void printTBStatistics() const;
+    int getSelectiveDepth() const;
+};
+
+void initReductionTable();
+std::string retrievePV(const SearchPV *pvLine);
+std::string scoreToString(int score);
 
 // Time constants
 constexpr uint64_t ONE_SECOND = 1000;
 constexpr uint64_t MAX_TIME = (1ULL << 63) - 1;
+constexpr uint64_t MAX_NODES = (1ULL << 63) - 1;
 
 // Search parameters
 constexpr int EASYMOVE_MARGIN = 150;
+// When continuing from the previous move's PV, start this many plies below
+// the depth left in that PV
+constexpr int CARRYOVER_DEPTH_MARGIN = 3;
 constexpr int NEAR_MATE_SCORE = 2500;
 // An arbitrary value, but this leaves 266 plies to account for hash table grafting.
 constexpr int MAX_PLY_MATE_SCORE = 32500;
@@ -0,0 +1,440 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "analysis.h"
+#include "hash.h"
+#include "notation.h"
+#include "search.h"
+#include "server.h"
+#include "timeman.h"
+#include "uci.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+ServerOptions::ServerOptions() {
+    maxSessions = DEFAULT_MAX_SESSIONS;
+    maxThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    hashMB = DEFAULT_HASH_SIZE;
+    sharedHash = false;
+}
+
+bool parseServerOptions(int argc, char **argv, ServerOptions &options) {
+    if (argc < 1) {
+        cerr << "Usage: laser serve <socket> [sessions <n>] [threads <n>] [hash <MB>] [shared]" << endl;
+        return false;
+    }
+    options.socketPath = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "shared") == 0) {
+            options.sharedHash = true;
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (i + 1 >= argc || !parseNumber(argv[i+1], value)) {
+            cerr << "Invalid server option: " << argv[i] << endl;
+            return false;
+        }
+        const char *name = argv[i];
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        i++;
+
+        if (strcmp(name, "sessions") == 0)
+            options.maxSessions = std::max(1, intValue);
+        else if (strcmp(name, "threads") == 0)
+            options.maxThreads = std::max(1, intValue);
+        else if (strcmp(name, "hash") == 0)
+            options.hashMB = std::max(MIN_HASH_SIZE, std::min(MAX_HASH_SIZE, value));
+        else {
+            cerr << "Invalid server option: " << name << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+void runServer(const ServerOptions &options) {
+    (void) options;
+    cerr << "Server mode is not supported on this platform" << endl;
+}
+
+#else
+
+/**
+ * @brief One client connection. Commands are read and answered on the
+ * session's own thread, while searches run on a second thread so that a stop
+ * command can be handled during the search.
+ */
+struct ServerSession {
+    int fd;
+    Search *search;
+    Board board;
+    int threads;
+    // Bytes received but not yet split into lines
+    std::string input;
+    std::thread searchThread;
+    std::mutex writeMutex;
+
+    ServerSession(int _fd, Search *_search) : fd(_fd), search(_search), threads(1) {}
+};
+
+static const ServerOptions *serverOptions;
+static Hash *sharedTable = nullptr;
+
+// Idle searches, each with its hash table and per-thread memory, are kept for
+// the next session instead of being freed
+static std::mutex poolMutex;
+static std::vector<Search *> idleSearches;
+static int activeSessions = 0;
+
+// Search threads not in use by any session
+static std::mutex threadMutex;
+static std::condition_variable threadsFreed;
+static int freeThreads = 0;
+
+static void serveSession(int fd);
+static bool readLine(ServerSession &session, string &line);
+static void sendLine(ServerSession &session, const string &line);
+static void startSearch(ServerSession &session, StringView command);
+static void searchInSession(ServerSession *session, TimeManagement limit);
+static void stopSearch(ServerSession &session);
+static bool setSessionPosition(ServerSession &session, StringView command);
+static Search *acquireSearch();
+static void releaseSearch(Search *search);
+static void acquireThreads(int n);
+static void releaseThreads(int n);
+
+
+/*
+ * Listens on a Unix domain socket and serves each connection on its own
+ * thread until the process is killed. Sessions speak a subset of UCI:
+ *   uci, isready, ucinewgame, position, go [depth <n> | nodes <n> |
+ *   movetime <ms> | infinite], stop, setoption name Threads value <n>, quit
+ * The magic, Zobrist and eval tables are set up once for all sessions.
+ */
+void runServer(const ServerOptions &options) {
+    serverOptions = &options;
+    freeThreads = options.maxThreads;
+    if (options.sharedHash)
+        sharedTable = new Hash(options.hashMB);
+
+    // A client that disconnects early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.length() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << options.socketPath << endl;
+        return;
+    }
+    std::strcpy(address.sun_path, options.socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.socketPath.c_str());
+    if (listener == -1 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0
+     || listen(listener, SERVER_BACKLOG) != 0) {
+        cerr << "Could not listen on " << options.socketPath << ": " << strerror(errno) << endl;
+        if (listener != -1)
+            close(listener);
+        return;
+    }
+    cerr << "Listening on " << options.socketPath << " (" << options.maxSessions << " sessions, "
+         << options.maxThreads << " threads)" << endl;
+
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            cerr << "Could not accept connection: " << strerror(errno) << endl;
+            break;
+        }
+
+        bool isAdmitted;
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            isAdmitted = (activeSessions < options.maxSessions);
+            if (isAdmitted)
+                activeSessions++;
+        }
+        if (!isAdmitted) {
+            const char busy[] = "info string server busy\n";
+            send(fd, busy, sizeof(busy) - 1, 0);
+            close(fd);
+            continue;
+        }
+        std::thread(serveSession, fd).detach();
+    }
+
+    close(listener);
+    unlink(options.socketPath.c_str());
+}
+
+static void serveSession(int fd) {
+    ServerSession session(fd, acquireSearch());
+    string line;
+
+    while (readLine(session, line)) {
+        StringView command(line);
+        StringView keyword = nextToken(command);
+
+        if (keyword == "uci") {
+            sendLine(session, "id name Laser");
+            sendLine(session, "id author Jeffrey An and Michael An");
+            sendLine(session, "option name Threads type spin default 1 min 1 max "
+                + std::to_string(serverOptions->maxThreads));
+            sendLine(session, "uciok");
+        }
+        else if (keyword == "isready")
+            sendLine(session, "readyok");
+        else if (keyword == "ucinewgame") {
+            stopSearch(session);
+            // A shared table belongs to the other sessions as well, so a new
+            // game only ages it
+            if (sharedTable == nullptr)
+                session.search->clearTables();
+            else {
+                session.search->clearSearchState();
+                sharedTable->incrementAge();
+            }
+        }
+        else if (keyword == "position") {
+            stopSearch(session);
+            if (!setSessionPosition(session, command))
+                sendLine(session, "info string invalid position");
+        }
+        else if (keyword == "go") {
+            stopSearch(session);
+            startSearch(session, command);
+        }
+        else if (keyword == "stop")
+            stopSearch(session);
+        else if (keyword == "setoption") {
+            // setoption name Threads value <n>
+            nextToken(command);
+            StringView name = nextToken(command);
+            nextToken(command);
+            uint64_t value = 0;
+            if ((name == "Threads" || name == "threads") && parseNumber(nextToken(command).toString().c_str(), value)) {
+                stopSearch(session);
+                session.threads = (int) std::max((uint64_t) 1, std::min(value, (uint64_t) serverOptions->maxThreads));
+            }
+            else
+                sendLine(session, "info string unsupported option");
+        }
+        else if (keyword == "quit")
+            break;
+        else if (!keyword.empty())
+            sendLine(session, "info string unknown command " + keyword.toString());
+    }
+
+    stopSearch(session);
+    close(fd);
+    releaseSearch(session.search);
+}
+
+static bool readLine(ServerSession &session, string &line) {
+    std::size_t end;
+    while ((end = session.input.find('\n')) == string::npos) {
+        char buffer[4096];
+        ssize_t received = recv(session.fd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            return false;
+        session.input.append(buffer, received);
+    }
+
+    line = session.input.substr(0, end);
+    session.input.erase(0, end + 1);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    return true;
+}
+
+// Both the session thread and the search thread write to the client
+static void sendLine(ServerSession &session, const string &line) {
+    std::lock_guard<std::mutex> lock(session.writeMutex);
+    string data = line + "\n";
+    std::size_t sent = 0;
+    while (sent < data.length()) {
+        ssize_t written = write(session.fd, data.data() + sent, data.length() - sent);
+        if (written <= 0)
+            return;
+        sent += written;
+    }
+}
+
+static void startSearch(ServerSession &session, StringView command) {
+    TimeManagement limit;
+    limit.searchMode = DEPTH;
+    limit.allotment = MAX_DEPTH;
+    limit.maxAllotment = 0;
+
+    for (StringView token = nextToken(command); !token.empty(); token = nextToken(command)) {
+        if (token == "infinite")
+            continue;
+        uint64_t value = 0;
+        if (!parseNumber(nextToken(command).toString().c_str(), value))
+            break;
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        if (token == "depth") {
+            limit.searchMode = DEPTH;
+            limit.allotment = std::min(MAX_DEPTH, intValue);
+        }
+        else if (token == "nodes") {
+            limit.searchMode = NODES;
+            limit.allotment = intValue;
+        }
+        else if (token == "movetime") {
+            limit.searchMode = MOVETIME;
+            limit.allotment = intValue;
+        }
+    }
+
+    // Reset before the search thread starts, so that a stop sent while the
+    // search waits for threads is not lost
+    session.search->isStop = false;
+    session.search->stopSignal = false;
+    session.searchThread = std::thread(searchInSession, &session, limit);
+}
+
+static void searchInSession(ServerSession *session, TimeManagement limit) {
+    Search *search = session->search;
+    MoveList movesToSearch;
+
+    acquireThreads(session->threads);
+    search->setNumThreads(session->threads);
+    search->setIterationCallback([session](const SearchResult &progress) {
+        std::stringstream info;
+        info << "info depth " << progress.depth << " score " << scoreToString(progress.score)
+             << " time " << progress.time << " nodes " << progress.nodes
+             << " nps " << 1000 * progress.nodes / std::max(progress.time, (uint64_t) 1)
+             << " pv " << retrievePV(&progress.pv);
+        sendLine(*session, info.str());
+    });
+    search->getBestMoveThreader(&session->board, &limit, &movesToSearch);
+    search->setIterationCallback(nullptr);
+    releaseThreads(session->threads);
+
+    const SearchResult &result = search->getResult();
+    if (result.bestMove == NULL_MOVE)
+        sendLine(*session, "bestmove none");
+    else if (result.ponder != NULL_MOVE)
+        sendLine(*session, "bestmove " + moveToString(result.bestMove) + " ponder " + moveToString(result.ponder));
+    else
+        sendLine(*session, "bestmove " + moveToString(result.bestMove));
+}
+
+// Commands that change the position or the search threads end any search in
+// progress first, as the UCI loop does. Only joining would leave the session
+// unable to read a stop after go infinite.
+static void stopSearch(ServerSession &session) {
+    session.search->isStop = true;
+    session.search->stopSignal = true;
+    if (session.searchThread.joinable())
+        session.searchThread.join();
+}
+
+// position [startpos | fen <fen>] [moves <moves>]
+static bool setSessionPosition(ServerSession &session, StringView command) {
+    Board board;
+    StringView positionType = nextToken(command);
+    if (positionType == "fen") {
+        if (!parseFEN(command, board, &command))
+            return false;
+    }
+    else if (!(positionType == "startpos"))
+        return false;
+
+    TwoFoldStack twoFoldPositions;
+    StringView moveList;
+    if (nextToken(command) == "moves")
+        moveList = command;
+    if (!playMoves(moveList, board, &twoFoldPositions))
+        return false;
+
+    session.board = board;
+    *session.search->getTwoFoldStackPointer() = twoFoldPositions;
+    return true;
+}
+
+static Search *acquireSearch() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!idleSearches.empty()) {
+            Search *search = idleSearches.back();
+            idleSearches.pop_back();
+            return search;
+        }
+    }
+
+    Search *search = new Search(sharedTable);
+    search->setSilent(true);
+    if (sharedTable == nullptr)
+        search->setHashSize(serverOptions->hashMB);
+    return search;
+}
+
+static void releaseSearch(Search *search) {
+    // The next session must not inherit this one's history or carried-over
+    // search, but a shared table still serves the other sessions
+    if (sharedTable == nullptr)
+        search->clearTables();
+    else
+        search->clearSearchState();
+    std::lock_guard<std::mutex> lock(poolMutex);
+    idleSearches.push_back(search);
+    activeSessions--;
+}
+
+// Waits until n search threads are free
+static void acquireThreads(int n) {
+    std::unique_lock<std::mutex> lock(threadMutex);
+    threadsFreed.wait(lock, [n] { return freeThreads >= n; });
+    freeThreads -= n;
+}
+
+static void releaseThreads(int n) {
+    {
+        std::lock_guard<std::mutex> lock(threadMutex);
+        freeThreads += n;
+    }
+    threadsFreed.notify_all();
+}
+
+#endif
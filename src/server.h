@@ -0,0 +1,49 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <cstdint>
+#include <string>
+
+constexpr int DEFAULT_MAX_SESSIONS = 64;
+constexpr int SERVER_BACKLOG = 64;
+
+/**
+ * @brief Settings for serving sessions over a Unix domain socket:
+ *   laser serve <socket> [sessions <n>] [threads <n>] [hash <MB>] [shared]
+ * At most "sessions" connections are served at once; more are turned away.
+ * "threads" caps the search threads of all sessions together, and searches
+ * wait until enough threads are free. Each session gets a hash table of the
+ * given size, or all sessions use one table with "shared".
+ */
+struct ServerOptions {
+    std::string socketPath;
+    int maxSessions;
+    int maxThreads;
+    uint64_t hashMB;
+    bool sharedHash;
+
+    ServerOptions();
+};
+
+bool parseServerOptions(int argc, char **argv, ServerOptions &options);
+void runServer(const ServerOptions &options);
+
+#endif
@@ -50,8 +50,6 @@
 #define TB_WPAWN TB_PAWN
 #define TB_BPAWN (TB_PAWN | 8)
 
-static LOCK_T TB_mutex;
-
 static int initialized = 0;
 static int num_paths = 0;
 static char *path_string = NULL;
@@ -61,6 +59,15 @@ static int TBnum_piece, TBnum_pawn;
 static struct TBEntry_piece TB_piece[TBMAX_PIECE];
 static struct TBEntry_pawn TB_pawn[TBMAX_PAWN];
 
+// The file name of each WDL entry, so that it can be mapped without a
+// position at hand, and whether its mapping is locked in memory
+struct TBFileInfo {
+  char name[16];
+  ubyte locked;
+};
+static struct TBFileInfo TB_piece_info[TBMAX_PIECE];
+static struct TBFileInfo TB_pawn_info[TBMAX_PAWN];
+
 static struct TBHashEntry TB_hash[1 << TBHASHBITS][HSHMAX];
 
 #define DTZ_ENTRIES 64
@@ -219,16 +226,20 @@ static void init_tb(char *str)
       printf("TBMAX_PIECE limit too low!\n");
       exit(1);
     }
+    strcpy(TB_piece_info[TBnum_piece].name, str);
+    TB_piece_info[TBnum_piece].locked = 0;
     entry = (struct TBEntry *)&TB_piece[TBnum_piece++];
   } else {
     if (TBnum_pawn == TBMAX_PAWN) {
       printf("TBMAX_PAWN limit too low!\n");
       exit(1);
     }
+    strcpy(TB_pawn_info[TBnum_pawn].name, str);
+    TB_pawn_info[TBnum_pawn].locked = 0;
     entry = (struct TBEntry *)&TB_pawn[TBnum_pawn++];
   }
   entry->key = key;
-  entry->ready = 0;
+  entry->ready = TB_UNINITIALIZED;
   entry->num = 0;
   for (i = 0; i < 16; i++)
     entry->num += pcs[i];
@@ -272,18 +283,20 @@ void init_tablebases(char *path)
     free(path_string);
     free(paths);
     struct TBEntry *entry;
+    // Only tables that were mapped have anything to free
     for (i = 0; i < TBnum_piece; i++) {
       entry = (struct TBEntry *)&TB_piece[i];
-      free_wdl_entry(entry);
+      if (entry->ready == TB_READY)
+        free_wdl_entry(entry);
     }
     for (i = 0; i < TBnum_pawn; i++) {
       entry = (struct TBEntry *)&TB_pawn[i];
-      free_wdl_entry(entry);
+      if (entry->ready == TB_READY)
+        free_wdl_entry(entry);
     }
     for (i = 0; i < DTZ_ENTRIES; i++)
       if (DTZ_table[i].entry)
 	free_dtz_entry(DTZ_table[i].entry);
-    LOCK_DESTROY(TB_mutex);
     path_string = NULL;
   }
 
@@ -309,8 +322,6 @@ void init_tablebases(char *path)
     while (path_string[j]) j++;
   }
 
-  LOCK_INIT(TB_mutex);
-
   TBnum_piece = TBnum_pawn = 0;
   TBlargest = 0;
 
@@ -32,19 +32,12 @@
 #define FD_ERR INVALID_HANDLE_VALUE
 #endif
 
-#ifndef __WIN32__
-#define LOCK_T pthread_mutex_t
-#define LOCK_INIT(x) pthread_mutex_init(&(x), NULL)
-#define LOCK_DESTROY(x) pthread_mutex_destroy(&(x))
-#define LOCK(x) pthread_mutex_lock(&(x))
-#define UNLOCK(x) pthread_mutex_unlock(&(x))
-#else
-#define LOCK_T HANDLE
-#define LOCK_INIT(x) do { x = CreateMutex(NULL, FALSE, NULL); } while (0)
-#define LOCK_DESTROY(x) CloseHandle(x)
-#define LOCK(x) WaitForSingleObject(x, INFINITE)
-#define UNLOCK(x) ReleaseMutex(x)
-#endif
+// States of a WDL table's lazy initialization, kept in the ready field of its
+// entry
+#define TB_UNINITIALIZED 0
+#define TB_READY 1
+#define TB_INITIALIZING 2
+#define TB_FAILED 3
 
 #define WDLSUFFIX ".rtbw"
 #define DTZSUFFIX ".rtbz"
@@ -26,6 +26,10 @@
 #define DECOMP64
 // #endif
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "../bbinit.h"
 #include "../board.h"
 #include "../common.h"
@@ -42,6 +46,11 @@ extern uint64_t zobristTable[794];
 
 #include "tbcore.c"
 
+static struct TBFileInfo *get_file_info(struct TBEntry *ptr);
+static int init_wdl_entry(struct TBEntry *ptr);
+static bool prefetch_wdl_entry(struct TBEntry *ptr, int lockPieces);
+static void add_residency(struct TBEntry *ptr, TBResidency &residency);
+
 // Given a position with 6 or fewer pieces, produce a text string
 // of the form KQPvKRP, where "KQP" represents the white pieces if
 // mirror == 0 and the black pieces if mirror == 1.
@@ -121,22 +130,10 @@ static int probe_wdl_table(const Board &b, int *success) {
     }
 
     ptr = ptr2[i].ptr;
-    if (!ptr->ready) {
-        LOCK(TB_mutex);
-        if (!ptr->ready) {
-            char str[16];
-            prt_str(b, str, ptr->key != key);
-            if (!init_table_wdl(ptr, str)) {
-                ptr2[i].key = 0ULL;
-                *success = 0;
-                UNLOCK(TB_mutex);
-                return 0;
-            }
-            // Memory barrier to ensure ptr->ready = 1 is not reordered.
-            __asm__ __volatile__ ("" ::: "memory");
-            ptr->ready = 1;
-        }
-        UNLOCK(TB_mutex);
+    if (__atomic_load_n(&ptr->ready, __ATOMIC_ACQUIRE) != TB_READY
+     && !init_wdl_entry(ptr)) {
+        *success = 0;
+        return 0;
     }
 
     int bside, mirror, cmirror;
@@ -197,6 +194,32 @@ static int probe_wdl_table(const Board &b, int *success) {
     return ((int)res) - 2;
 }
 
+static struct TBFileInfo *get_file_info(struct TBEntry *ptr) {
+    if (ptr->has_pawns)
+        return &TB_pawn_info[(struct TBEntry_pawn *) ptr - TB_pawn];
+    return &TB_piece_info[(struct TBEntry_piece *) ptr - TB_piece];
+}
+
+// Maps and initializes a WDL table the first time it is probed. The first
+// prober claims the entry with a compare-and-swap and sets it up without any
+// global lock, so only threads probing that same table wait for it, while
+// probes of other tables carry on. Returns 0 if the table cannot be used.
+static int init_wdl_entry(struct TBEntry *ptr) {
+    ubyte state = TB_UNINITIALIZED;
+    if (__atomic_compare_exchange_n(&ptr->ready, &state, TB_INITIALIZING, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        state = init_table_wdl(ptr, get_file_info(ptr)->name) ? TB_READY : TB_FAILED;
+        __atomic_store_n(&ptr->ready, state, __ATOMIC_RELEASE);
+        return state == TB_READY;
+    }
+
+    while (state == TB_INITIALIZING) {
+        std::this_thread::yield();
+        state = __atomic_load_n(&ptr->ready, __ATOMIC_ACQUIRE);
+    }
+    return state == TB_READY;
+}
+
 // The value of wdl MUST correspond to the WDL value of the position without
 // en passant rights.
 static int probe_dtz_table(const Board &b, int wdl, int *success) {
@@ -570,8 +593,7 @@ int probe_dtz(const Board &b, int *success) {
 
 // Check whether there has been at least one repetition of positions
 // since the last capture or pawn move.
-static int has_repeated() {
-    TwoFoldStack *tfp = getTwoFoldStackPointer();
+static int has_repeated(const TwoFoldStack *tfp) {
     if (tfp->length < 3)
         return false;
 
@@ -597,7 +619,8 @@ static int wdl_to_value[5] = {
 //
 // A return value of 0 indicates that not all probes were successful and that
 // no moves were filtered out.
-int root_probe(const Board *b, MoveList &rootMoves, ScoreList &scores, int &TBScore) {
+int root_probe(const Board *b, const TwoFoldStack *twoFoldPositions, MoveList &rootMoves,
+        ScoreList &scores, int &TBScore) {
     int success;
 
     int dtz = probe_dtz(*b, &success);
@@ -663,7 +686,7 @@ int root_probe(const Board *b, MoveList &rootMoves, ScoreList &scores, int &TBSc
         int max = best;
         // If the current phase has not seen repetitions, then try all moves
         // that stay safely within the 50-move budget, if there are any.
-        if (!has_repeated() && best + cnt50 <= 99)
+        if (!has_repeated(twoFoldPositions) && best + cnt50 <= 99)
             max = 99 - cnt50;
         for (unsigned int i = 0; i < rootMoves.size(); i++) {
             int v = scores.get(i);
@@ -743,3 +766,70 @@ int root_probe_wdl(const Board *b, MoveList &rootMoves, ScoreList &scores, int &
 
     return 1;
 }
+
+/*
+ * Maps every WDL table now rather than at its first probe, and asks the kernel
+ * to read the files in the background, so that the first probes in a timed
+ * search do not stall on page faults. The mappings of tables with at most
+ * lockPieces pieces, which are probed the most, are also locked in memory so
+ * that they are not evicted under memory pressure. Returns the number of
+ * tables that could not be locked.
+ */
+int prefetch_tablebases(int lockPieces) {
+    int lockFailures = 0;
+    for (int i = 0; i < TBnum_piece; i++)
+        lockFailures += !prefetch_wdl_entry((struct TBEntry *) &TB_piece[i], lockPieces);
+    for (int i = 0; i < TBnum_pawn; i++)
+        lockFailures += !prefetch_wdl_entry((struct TBEntry *) &TB_pawn[i], lockPieces);
+    return lockFailures;
+}
+
+// Counts the WDL tables that are mapped, and how many of their bytes are in
+// memory and locked there
+TBResidency get_tb_residency() {
+    TBResidency residency;
+    residency.tables = TBnum_piece + TBnum_pawn;
+    residency.mapped = 0;
+    residency.mappedBytes = residency.residentBytes = residency.lockedBytes = 0;
+    for (int i = 0; i < TBnum_piece; i++)
+        add_residency((struct TBEntry *) &TB_piece[i], residency);
+    for (int i = 0; i < TBnum_pawn; i++)
+        add_residency((struct TBEntry *) &TB_pawn[i], residency);
+    return residency;
+}
+
+// Returns false only if the table should have been locked but could not be
+static bool prefetch_wdl_entry(struct TBEntry *ptr, int lockPieces) {
+    if (__atomic_load_n(&ptr->ready, __ATOMIC_ACQUIRE) != TB_READY && !init_wdl_entry(ptr))
+        return true;
+#ifndef __WIN32__
+    madvise(ptr->data, ptr->mapping, MADV_WILLNEED);
+    struct TBFileInfo *info = get_file_info(ptr);
+    if (ptr->num <= lockPieces && !info->locked) {
+        if (mlock(ptr->data, ptr->mapping) != 0)
+            return false;
+        info->locked = 1;
+    }
+#endif
+    return true;
+}
+
+static void add_residency(struct TBEntry *ptr, TBResidency &residency) {
+    if (__atomic_load_n(&ptr->ready, __ATOMIC_ACQUIRE) != TB_READY)
+        return;
+    residency.mapped++;
+#ifndef __WIN32__
+    residency.mappedBytes += ptr->mapping;
+    if (get_file_info(ptr)->locked)
+        residency.lockedBytes += ptr->mapping;
+
+    uint64 pageSize = (uint64) sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((ptr->mapping + pageSize - 1) / pageSize);
+    if (mincore(ptr->data, ptr->mapping, pages.data()) == 0) {
+        uint64 resident = 0;
+        for (unsigned int i = 0; i < pages.size(); i++)
+            resident += pages[i] & 1;
+        residency.residentBytes += std::min(resident * pageSize, ptr->mapping);
+    }
+#endif
+}
@@ -23,12 +23,30 @@
 #include "../common.h"
 #include "../board.h"
 
+struct TwoFoldStack;
+
 extern int TBlargest; // 5 if 5-piece tables, 6 if 6-piece tables were found.
 
 void init_tablebases(char *path);
 int probe_wdl(const Board &b, int *success);
 int probe_dtz(const Board &b, int *success);
-int root_probe(const Board *b, MoveList &rootMoves, ScoreList &scores, int &TBScore);
+int root_probe(const Board *b, const TwoFoldStack *twoFoldPositions, MoveList &rootMoves,
+    ScoreList &scores, int &TBScore);
 int root_probe_wdl(const Board *b, MoveList &rootMoves, ScoreList &scores, int &TBScore);
 
+/**
+ * @brief How much of the WDL tables is mapped, and how much of that is in
+ * memory and locked there.
+ */
+struct TBResidency {
+    int tables;
+    int mapped;
+    uint64_t mappedBytes;
+    uint64_t residentBytes;
+    uint64_t lockedBytes;
+};
+
+int prefetch_tablebases(int lockPieces);
+TBResidency get_tb_residency();
+
 #endif
@@ -20,45 +20,149 @@
 #include <atomic>
 #include <cmath>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <thread>
 #include <random>
 
+#include "analysis.h"
+#include "annotate.h"
 #include "common.h"
 #include "bbinit.h"
 #include "board.h"
+#include "book.h"
+#include "cluster.h"
+#include "datagen.h"
 #include "eval.h"
+#include "instrument.h"
+#include "match.h"
+#include "notation.h"
+#include "output.h"
+#include "packedpos.h"
+#include "resultcache.h"
 #include "search.h"
+#include "server.h"
 #include "timeman.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
-using std::cout;
 using std::cerr;
 using std::endl;
 using std::string;
 
-constexpr char STARTPOS[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
-void setPosition(string &input, std::vector<string> &inputVector, Board &board);
-std::vector<string> split(const string &s, char d);
-Move stringToMove(const string &moveStr, Board &b, bool &reversible);
+void setPosition(string &input, Board &board);
 string boardToString(Board &board);
 bool equalsIgnoreCase(const std::string &s1, const std::string &s2);
 void stringToLowerCase(std::string &s);
+/**
+ * @brief Settings for the bench command:
+ *   bench [depth] [file <positions>] [depth <n>] [threads <n>] [hash <MB>]
+ *       [runs <n>] [warmup <n>] [json]
+ * Every run searches each position to the given depth from cleared tables.
+ * Warm-up runs are searched the same way but left out of the statistics.
+ */
+struct BenchOptions {
+    string positionsFile;
+    int depth;
+    int threads;
+    uint64_t hashMB;
+    int runs;
+    int warmupRuns;
+    bool jsonOutput;
+
+    BenchOptions() : depth(DEFAULT_BENCH_DEPTH), threads(1), hashMB(DEFAULT_HASH_SIZE),
+        runs(1), warmupRuns(0), jsonOutput(false) {}
+};
+
 void clearAll(Board &board);
-uint64_t perft(Board &b, int color, int depth, uint64_t &captures);
-void runBenchmark(Board &b, int depth);
+bool parseBenchOptions(const std::vector<string> &args, BenchOptions &options);
+void runBenchmark(const BenchOptions &options);
+double getStudentT95(int degrees);
+void runFENBenchmark(int iterations);
+void runTBBenchmark(const string &path, int threads);
+bool isCacheableSearch(const string &input);
+bool playCachedResult(const Board &board);
+void runSearch(Board *board, TimeManagement limit, bool cacheable, bool useCluster);
+void updateBook();
+void prefetchTablebases();
+void printTBResidency();
 
 
 static int BUFFER_TIME = DEFAULT_BUFFER_TIME;
+// The last position command, which the next one may extend
+static string lastPositionInput;
 MoveList movesToSearch;
 TimeManagement timeParams;
-// Declared in search.cpp
-extern std::atomic<bool> isStop;
-extern std::atomic<bool> stopSignal;
+// The search driven by UCI commands
+static Hash transpositionTable(DEFAULT_HASH_SIZE);
+static Search uciSearch(&transpositionTable);
+// Helper processes joining our searches, if a cluster socket is set
+static Cluster cluster;
+// Results of earlier searches, kept on disk across runs
+static ResultCache resultCache;
+static string resultCachePath;
+static uint64_t resultCacheSize = DEFAULT_RESULT_CACHE_SIZE;
+// Set when a search is stopped early, so that its result is not cached
+static std::atomic<bool> searchInterrupted(false);
+// Opening book, used once a book file is loaded
+static PolyglotBook book;
+static int bookDepth = DEFAULT_BOOK_DEPTH;
+static bool bookBestMove = false;
+// Warm-up of the Syzygy tables when they are loaded
+static bool syzygyPrefetch = false;
+static int syzygyLockPieces = DEFAULT_SYZYGY_LOCK_PIECES;
+
+// Positions used by the bench commands
+static const std::vector<string> benchPositions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r2q4/pp1k1pp1/2p1r1np/5p2/2N5/1P5Q/5PPP/3RR1K1 b - -",
+    "5k2/1qr2pp1/2Np1n1r/QB2p3/2R4p/3PPRPb/PP2P2P/6K1 w - -",
+    "r2r2k1/2p2pp1/p1n4p/1qbnp3/2Q5/1PPP1RPP/3NN2K/R1B5 b - -",
+    "8/3k4/p6Q/pq6/3p4/1P6/P3p1P1/6K1 w - -",
+    "8/8/k7/2B5/P1K5/8/8/1r6 w - -",
+    "8/8/8/p1k4p/P2R3P/2P5/1K6/5q2 w - -",
+    "rnbq1k1r/ppp1ppb1/5np1/1B1pN2p/P2P1P2/2N1P3/1PP3PP/R1BQK2R w KQ -",
+    "4r3/6pp/2p1p1k1/4Q2n/1r2Pp2/8/6PP/2R3K1 w - -",
+    "8/3k2p1/p2P4/P5p1/8/1P1R1P2/5r2/3K4 w - -",
+    "r5k1/1bqnbp1p/r3p1p1/pp1pP3/2pP1P2/P1P2N1P/1P2NBP1/R2Q1RK1 b - -",
+    "r1bqk2r/1ppnbppp/p1np4/4p1P1/4PP2/3P1N1P/PPP5/RNBQKBR1 b Qkq -",
+    "5nk1/6pp/8/pNpp4/P7/1P1Pp3/6PP/6K1 w - -",
+    "2r2rk1/1p2npp1/1q1b1nbp/p2p4/P2N3P/BPN1P3/4BPP1/2RQ1RK1 w - -",
+    "8/2b3p1/4knNp/2p4P/1pPp1P2/1P1P1BPK/8/8 w - -"
+};
+
+// Endgames of different material used by tbbench, one table each
+static const std::vector<string> tbBenchPositions = {
+    "8/8/8/8/7k/8/8/Q3K3 w - -",
+    "8/8/8/8/7k/8/8/R3K3 w - -",
+    "8/8/8/8/7k/8/4P3/4K3 w - -",
+    "8/8/8/8/7k/8/8/1BN1K3 w - -",
+    "8/8/8/8/7k/8/8/1BB1K3 w - -",
+    "8/8/8/8/7k/8/8/1NN1K3 w - -",
+    "3r4/8/8/8/7k/8/8/Q3K3 w - -",
+    "3q4/8/8/8/7k/8/8/Q3K3 w - -",
+    "3r4/8/8/8/7k/8/8/R3K3 w - -",
+    "3n4/8/8/8/7k/8/8/R3K3 w - -",
+    "3b4/8/8/8/7k/8/8/R3K3 w - -",
+    "8/4p3/8/8/7k/8/8/Q3K3 w - -",
+    "8/4p3/8/8/7k/8/8/R3K3 w - -",
+    "8/4p3/8/8/7k/8/4P3/4K3 w - -",
+    "8/8/8/8/7k/8/3PP3/4K3 w - -",
+    "3n4/8/8/8/7k/8/4P3/4K3 w - -",
+    "3r4/8/8/8/7k/8/4P3/R3K3 w - -",
+    "3b4/8/8/8/7k/8/4P3/R3K3 w - -",
+    "2rr4/8/8/8/7k/8/8/Q3K3 w - -",
+    "3q4/8/8/8/7k/8/8/RR2K3 w - -",
+    "3r4/8/8/8/7k/8/8/1B1RK3 w - -",
+    "3r4/8/8/8/7k/8/8/1N1RK3 w - -",
+    "3b4/8/8/8/7k/8/3P4/2B1K3 w - -",
+    "3q4/8/8/8/7k/8/4P3/Q3K3 w - -",
+    "8/4p3/8/8/7k/8/3PP3/4K3 w - -",
+    "8/4p3/8/8/7k/8/4P3/R3K3 w - -"
+};
 
 
 int main(int argc, char **argv) {
@@ -67,12 +171,8 @@ int main(int argc, char **argv) {
     initDistances();
     initZobristTable();
     initInBetweenTable();
-    initPerThreadMemory();
     initReductionTable();
 
-    setMultiPV(DEFAULT_MULTI_PV);
-    setNumThreads(DEFAULT_THREADS);
-
     string input;
     std::vector<string> inputVector;
     string name = "Laser";
@@ -82,11 +182,97 @@ int main(int argc, char **argv) {
 
     Board board = fenToBoard(STARTPOS);
 
-    cout << name << " " << version << " by " << author << endl;
+    // All UCI output goes through a queue drained by a dedicated thread
+    startOutputThread();
+
+    OutputLine() << name << " " << version << " by " << author;
 
     // Run benchmark from command line with given depth
     if (argc > 1 && strcmp(argv[1], "bench") == 0) {
-        runBenchmark(board, argc > 2 ? atoi(argv[2]) : 0);
+        BenchOptions options;
+        if (parseBenchOptions(std::vector<string>(argv + 2, argv + argc), options))
+            runBenchmark(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Measure Syzygy probing from several threads on cold tables
+    if (argc > 2 && strcmp(argv[1], "tbbench") == 0) {
+        runTBBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : (int) std::thread::hardware_concurrency());
+        stopOutputThread();
+        return 0;
+    }
+
+    // Analyze a file of FEN/EPD positions from the command line
+    if (argc > 1 && strcmp(argv[1], "analyze") == 0) {
+        AnalysisOptions options;
+        if (parseAnalysisOptions(argc - 2, argv + 2, options))
+            runAnalysis(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Serve many sessions from one process over a Unix domain socket
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        ServerOptions options;
+        if (parseServerOptions(argc - 2, argv + 2, options))
+            runServer(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Join the searches of a coordinating process as a cluster helper
+    if (argc > 1 && strcmp(argv[1], "cluster") == 0) {
+        AnalysisOptions options;
+        if (parseAnalysisOptions(argc - 2, argv + 2, options))
+            runClusterHelper(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Play a self-play match between two engine configurations
+    if (argc > 1 && strcmp(argv[1], "match") == 0) {
+        MatchOptions options;
+        if (parseMatchOptions(argc - 2, argv + 2, options))
+            runMatch(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Generate training data from self-play games
+    if (argc > 1 && strcmp(argv[1], "datagen") == 0) {
+        DatagenOptions options;
+        if (parseDatagenOptions(argc - 2, argv + 2, options))
+            runDatagen(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Convert between packed positions and FEN or EPD
+    if (argc > 1 && strcmp(argv[1], "convert") == 0) {
+        if (argc < 4)
+            cerr << "Usage: laser convert <input> <output>" << endl;
+        else
+            convertPositions(argv[2], argv[3]);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Score every legal move of the positions in a file
+    if (argc > 1 && strcmp(argv[1], "scoremoves") == 0) {
+        AnalysisOptions options;
+        if (parseAnalysisOptions(argc - 2, argv + 2, options))
+            runRootMoveScoring(options);
+        stopOutputThread();
+        return 0;
+    }
+
+    // Annotate the games of a PGN file from the command line
+    if (argc > 1 && strcmp(argv[1], "annotate") == 0) {
+        AnalysisOptions options;
+        if (parseAnalysisOptions(argc - 2, argv + 2, options))
+            runAnnotation(options);
+        stopOutputThread();
         return 0;
     }
 
@@ -96,36 +282,47 @@ int main(int argc, char **argv) {
         std::cin.clear();
 
         // Ignore all input other than "stop", "quit", and "ponderhit" while running a search.
-        if (!isStop && input != "stop" && input != "quit" && input != "ponderhit")
+        if (!uciSearch.isStop && input != "stop" && input != "quit" && input != "ponderhit")
             continue;
 
         if (input == "uci") {
-            cout << "id name " << name << " " << version << endl;
-            cout << "id author " << author << endl;
-            cout << "option name Threads type spin default " << DEFAULT_THREADS
-                 << " min " << MIN_THREADS << " max " << MAX_THREADS << endl;
-            cout << "option name Hash type spin default " << DEFAULT_HASH_SIZE
-                 << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE << endl;
-            cout << "option name Ponder type check default false" << endl;
-            cout << "option name MultiPV type spin default " << DEFAULT_MULTI_PV
-                 << " min " << MIN_MULTI_PV << " max " << MAX_MULTI_PV << endl;
-            cout << "option name BufferTime type spin default " << DEFAULT_BUFFER_TIME
-                 << " min " << MIN_BUFFER_TIME << " max " << MAX_BUFFER_TIME << endl;
-            cout << "option name SyzygyPath type string default <empty>" << endl;
-            cout << "option name ScaleMaterial type spin default " << DEFAULT_EVAL_SCALE
-                 << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << endl;
-            cout << "option name ScaleKingSafety type spin default " << DEFAULT_EVAL_SCALE
-                 << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << endl;
-            cout << "uciok" << endl;
+            OutputLine() << "id name " << name << " " << version;
+            OutputLine() << "id author " << author;
+            OutputLine() << "option name Threads type spin default " << DEFAULT_THREADS
+                         << " min " << MIN_THREADS << " max " << MAX_THREADS;
+            OutputLine() << "option name Hash type spin default " << DEFAULT_HASH_SIZE
+                         << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE;
+            OutputLine() << "option name Ponder type check default false";
+            OutputLine() << "option name MultiPV type spin default " << DEFAULT_MULTI_PV
+                         << " min " << MIN_MULTI_PV << " max " << MAX_MULTI_PV;
+            OutputLine() << "option name BufferTime type spin default " << DEFAULT_BUFFER_TIME
+                         << " min " << MIN_BUFFER_TIME << " max " << MAX_BUFFER_TIME;
+            OutputLine() << "option name SyzygyPath type string default <empty>";
+            OutputLine() << "option name SyzygyPrefetch type check default false";
+            OutputLine() << "option name SyzygyLockPieces type spin default " << DEFAULT_SYZYGY_LOCK_PIECES
+                         << " min " << MIN_SYZYGY_LOCK_PIECES << " max " << MAX_SYZYGY_LOCK_PIECES;
+            OutputLine() << "option name ResultCache type string default <empty>";
+            OutputLine() << "option name ClusterSocket type string default <empty>";
+            OutputLine() << "option name ResultCacheSize type spin default " << DEFAULT_RESULT_CACHE_SIZE
+                         << " min " << MIN_RESULT_CACHE_SIZE << " max " << MAX_RESULT_CACHE_SIZE;
+            OutputLine() << "option name BookFile type string default <empty>";
+            OutputLine() << "option name BookDepth type spin default " << DEFAULT_BOOK_DEPTH
+                         << " min " << MIN_BOOK_DEPTH << " max " << MAX_BOOK_DEPTH;
+            OutputLine() << "option name BookBestMove type check default false";
+            OutputLine() << "option name ScaleMaterial type spin default " << DEFAULT_EVAL_SCALE
+                         << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE;
+            OutputLine() << "option name ScaleKingSafety type spin default " << DEFAULT_EVAL_SCALE
+                         << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE;
+            OutputLine() << "uciok";
         }
-        else if (input == "isready") cout << "readyok" << endl;
+        else if (input == "isready") OutputLine() << "readyok";
         else if (input == "ucinewgame") clearAll(board);
-        else if (input.substr(0, 8) == "position") setPosition(input, inputVector, board);
-        else if (input.substr(0, 2) == "go" && isStop) {
+        else if (input.substr(0, 8) == "position") setPosition(input, board);
+        else if (input.substr(0, 2) == "go" && uciSearch.isStop) {
             std::vector<string>::iterator it;
 
             if (input.find("ponder") != string::npos)
-                startPonder();
+                uciSearch.startPonder();
 
             if (input.find("searchmoves") != string::npos) {
                 movesToSearch.clear();
@@ -146,6 +343,12 @@ int main(int argc, char **argv) {
                 it++;
                 timeParams.allotment = std::stoi(*it);
             }
+            else if (input.find("nodes") != string::npos && inputVector.size() > 2) {
+                timeParams.searchMode = NODES;
+                it = find(inputVector.begin(), inputVector.end(), "nodes");
+                it++;
+                timeParams.allotment = std::stoi(*it);
+            }
             else if (input.find("depth") != string::npos && inputVector.size() > 2) {
                 timeParams.searchMode = DEPTH;
                 it = find(inputVector.begin(), inputVector.end(), "depth");
@@ -204,31 +407,39 @@ int main(int argc, char **argv) {
                 }
             }
 
-            isStop = false;
-            stopSignal = false;
+            bool cacheable = isCacheableSearch(input);
+            bool useCluster = cluster.isOpen() && cluster.getNumHelpers() > 0
+                           && input.find("ponder") == string::npos && movesToSearch.size() == 0;
+            uciSearch.isStop = false;
+            uciSearch.stopSignal = false;
+            searchInterrupted = false;
             if (searchThread.joinable()) searchThread.join();
-            searchThread = std::thread(getBestMoveThreader, &board, &timeParams, &movesToSearch);
+            if (!uciSearch.playInstantMove(&board, &timeParams, &movesToSearch)
+             && !(cacheable && playCachedResult(board)))
+                searchThread = std::thread(runSearch, &board, timeParams, cacheable, useCluster);
         }
         else if (input == "ponderhit") {
-            stopPonder();
+            uciSearch.stopPonder();
         }
 
         else if (input == "stop") {
-            stopPonder();
-            isStop = true;
-            stopSignal = true;
+            searchInterrupted = true;
+            uciSearch.stopPonder();
+            uciSearch.isStop = true;
+            uciSearch.stopSignal = true;
             if (searchThread.joinable()) searchThread.join();
         }
         else if (input == "quit") {
-            stopPonder();
-            isStop = true;
-            stopSignal = true;
+            searchInterrupted = true;
+            uciSearch.stopPonder();
+            uciSearch.isStop = true;
+            uciSearch.stopSignal = true;
             if (searchThread.joinable()) searchThread.join();
             break;
         }
         else if (input.substr(0, 9) == "setoption" && inputVector.size() >= 5) {
             if (inputVector.at(1) != "name" || inputVector.at(3) != "value") {
-                cout << "info string Invalid option format." << endl;
+                OutputLine() << "info string Invalid option format.";
             }
             else {
                 if (inputVector.at(2) == "threads") {
@@ -237,7 +448,7 @@ int main(int argc, char **argv) {
                         threads = MIN_THREADS;
                     if (threads > MAX_THREADS)
                         threads = MAX_THREADS;
-                    setNumThreads(threads);
+                    uciSearch.setNumThreads(threads);
                 }
                 else if (inputVector.at(2) == "hash") {
                     uint64_t MB = std::stoull(inputVector.at(4));
@@ -245,7 +456,7 @@ int main(int argc, char **argv) {
                         MB = MIN_HASH_SIZE;
                     if (MB > MAX_HASH_SIZE)
                         MB = MAX_HASH_SIZE;
-                    setHashSize(MB);
+                    uciSearch.setHashSize(MB);
                 }
                 else if (inputVector.at(2) == "ponder") {
                     // do nothing
@@ -256,7 +467,7 @@ int main(int argc, char **argv) {
                         multiPV = MIN_MULTI_PV;
                     if (multiPV > MAX_MULTI_PV)
                         multiPV = MAX_MULTI_PV;
-                    setMultiPV((unsigned int) multiPV);
+                    uciSearch.setMultiPV((unsigned int) multiPV);
                 }
                 else if (inputVector.at(2) == "buffertime") {
                     BUFFER_TIME = std::stoi(inputVector.at(4));
@@ -274,6 +485,70 @@ int main(int argc, char **argv) {
                     std::strcpy(c_path, path.c_str());
                     init_tablebases(c_path);
                     free(c_path);
+                    prefetchTablebases();
+                }
+                else if (inputVector.at(2) == "syzygyprefetch") {
+                    syzygyPrefetch = (inputVector.at(4) == "true");
+                    prefetchTablebases();
+                }
+                else if (inputVector.at(2) == "syzygylockpieces") {
+                    syzygyLockPieces = std::stoi(inputVector.at(4));
+                    if (syzygyLockPieces < MIN_SYZYGY_LOCK_PIECES)
+                        syzygyLockPieces = MIN_SYZYGY_LOCK_PIECES;
+                    if (syzygyLockPieces > MAX_SYZYGY_LOCK_PIECES)
+                        syzygyLockPieces = MAX_SYZYGY_LOCK_PIECES;
+                    prefetchTablebases();
+                }
+                else if (inputVector.at(2) == "resultcache") {
+                    resultCachePath = inputVector.at(4);
+                    for (unsigned int i = 5; i < inputVector.size(); i++)
+                        resultCachePath += string(" ") + inputVector.at(i);
+                    if (resultCachePath == "<empty>")
+                        resultCachePath.clear();
+
+                    resultCache.close();
+                    if (!resultCachePath.empty() && !resultCache.open(resultCachePath, resultCacheSize))
+                        OutputLine() << "info string Could not open result cache.";
+                }
+                else if (inputVector.at(2) == "clustersocket") {
+                    string path = inputVector.at(4);
+                    for (unsigned int i = 5; i < inputVector.size(); i++)
+                        path += string(" ") + inputVector.at(i);
+
+                    cluster.close();
+                    if (path != "<empty>" && !path.empty() && !cluster.open(path, &transpositionTable))
+                        OutputLine() << "info string Could not open cluster socket.";
+                }
+                else if (inputVector.at(2) == "resultcachesize") {
+                    resultCacheSize = std::stoull(inputVector.at(4));
+                    if (resultCacheSize < MIN_RESULT_CACHE_SIZE)
+                        resultCacheSize = MIN_RESULT_CACHE_SIZE;
+                    if (resultCacheSize > MAX_RESULT_CACHE_SIZE)
+                        resultCacheSize = MAX_RESULT_CACHE_SIZE;
+                    if (resultCache.isOpen())
+                        resultCache.open(resultCachePath, resultCacheSize);
+                }
+                else if (inputVector.at(2) == "bookfile") {
+                    string path = inputVector.at(4);
+                    for (unsigned int i = 5; i < inputVector.size(); i++)
+                        path += string(" ") + inputVector.at(i);
+
+                    book.close();
+                    if (path != "<empty>" && !path.empty() && !book.open(path))
+                        OutputLine() << "info string Could not open book.";
+                    updateBook();
+                }
+                else if (inputVector.at(2) == "bookdepth") {
+                    bookDepth = std::stoi(inputVector.at(4));
+                    if (bookDepth < MIN_BOOK_DEPTH)
+                        bookDepth = MIN_BOOK_DEPTH;
+                    if (bookDepth > MAX_BOOK_DEPTH)
+                        bookDepth = MAX_BOOK_DEPTH;
+                    updateBook();
+                }
+                else if (inputVector.at(2) == "bookbestmove") {
+                    bookBestMove = (inputVector.at(4) == "true");
+                    updateBook();
                 }
                 else if (inputVector.at(2) == "scalematerial") {
                     int scale = std::stoi(inputVector.at(4));
@@ -292,7 +567,7 @@ int main(int argc, char **argv) {
                     setKingSafetyScale(scale);
                 }
                 else
-                    cout << "info string Invalid option." << endl;
+                    OutputLine() << "info string Invalid option.";
             }
         }
 
@@ -313,11 +588,20 @@ int main(int argc, char **argv) {
             cerr << "Time: " << time << endl;
             cerr << "Nodes/second: " << 1000 * nodes / time << endl;
         }
-        else if (input.substr(0, 5) == "bench") {
-            int depth = 0;
+        else if (input.substr(0, 8) == "fenbench") {
+            int iterations = 10000;
             if (inputVector.size() == 2)
-                depth = std::stoi(inputVector.at(1));
-            runBenchmark(board, depth);
+                iterations = std::stoi(inputVector.at(1));
+            runFENBenchmark(iterations);
+        }
+        else if (input == "cachestats") resultCache.printStatistics();
+        else if (input == "tbstats") printTBResidency();
+        else if (input == "instrument") printInstrumentStats();
+        else if (input == "instrument reset") resetInstrumentStats();
+        else if (input.substr(0, 5) == "bench") {
+            BenchOptions options;
+            if (parseBenchOptions(std::vector<string>(inputVector.begin() + 1, inputVector.end()), options))
+                runBenchmark(options);
         }
 
         else if (input == "eval") {
@@ -328,192 +612,62 @@ int main(int argc, char **argv) {
         // According to UCI protocol, inputs that do not make sense are ignored
     }
 
+    stopOutputThread();
     return 0;
 }
 
-void setPosition(string &input, std::vector<string> &inputVector, Board &board) {
-    string pos;
-
-    if (input.find("startpos") != string::npos)
-        pos = STARTPOS;
-
-    if (input.find("fen") != string::npos) {
-        if (inputVector.size() < 5 || inputVector.at(4) == "moves") {
-            pos = inputVector.at(2) + ' ' + inputVector.at(3) + " - -";
-        }
-        else if (inputVector.size() < 7 || inputVector.at(6) == "moves") {
-            pos = inputVector.at(2) + ' ' + inputVector.at(3) + ' ' + inputVector.at(4) + ' '
-                + inputVector.at(5);
-        }
-        else {
-            pos = inputVector.at(2) + ' ' + inputVector.at(3) + ' ' + inputVector.at(4) + ' '
-                + inputVector.at(5) + ' ' + inputVector.at(6) + ' ' + inputVector.at(7);
+void setPosition(string &input, Board &board) {
+    TwoFoldStack *twoFoldPositions = uciSearch.getTwoFoldStackPointer();
+    StringView moveList;
+    bool extendsLast = false;
+
+    // GUIs resend the whole game with every move. If this command only adds
+    // moves to the previous one, play just the new moves on the current board
+    // instead of replaying the game from the start.
+    if (!lastPositionInput.empty()
+     && input.compare(0, lastPositionInput.length(), lastPositionInput) == 0
+     && (input.length() == lastPositionInput.length() || input[lastPositionInput.length()] == ' ')) {
+        moveList = StringView(input.data() + lastPositionInput.length(), input.data() + input.length());
+        extendsLast = true;
+        // The previous command had no move list, so anything else that follows
+        // (e.g. the rest of a FEN) changes the position itself
+        if (lastPositionInput.find("moves") == string::npos) {
+            StringView keyword = nextToken(moveList);
+            if (!keyword.empty() && !(keyword == "moves"))
+                extendsLast = false;
         }
     }
-
-    board = fenToBoard(pos);
-    TwoFoldStack *twoFoldPositions = getTwoFoldStackPointer();
-    twoFoldPositions->clear();
-
-    size_t moveListStart = input.find("moves");
-    if (moveListStart != string::npos) {
-        moveListStart += 6;
-        // Check for a non-empty movelist
-        if (moveListStart < input.length()) {
-            string moveList = input.substr(moveListStart);
-            std::istringstream is(moveList);
-            // moveStr contains the move in long algebraic notation
-            string moveStr;
-            while (is >> moveStr) {
-                bool reversible;
-                Move m = stringToMove(moveStr, board, reversible);
-
-                // Record positions on two fold stack.
-                twoFoldPositions->push(board.getZobristKey());
-                // The stack is cleared for captures, pawn moves, and castles, which are all
-                // irreversible
-                if (!reversible)
-                    twoFoldPositions->clear();
-
-                board.doMove(m, board.getPlayerToMove());
-            }
+    if (!extendsLast) {
+        moveList = StringView();
+        // Everything between "fen" and "moves" is parsed in place
+        StringView command(input);
+        nextToken(command);
+        StringView positionType = nextToken(command);
+        if (positionType == "fen") {
+            if (!parseFEN(command, board, &command))
+                board = fenToBoard(STARTPOS);
         }
-    }
+        else
+            board = fenToBoard(STARTPOS);
+        twoFoldPositions->clear();
 
-    twoFoldPositions->setRootEnd();
-}
-
-// Splits a string s with delimiter d.
-std::vector<string> split(const string &s, char d) {
-    std::vector<string> v;
-    std::stringstream ss(s);
-    string item;
-    while (getline(ss, item, d)) {
-        v.push_back(item);
+        if (nextToken(command) == "moves")
+            moveList = command;
     }
-    return v;
-}
-
-Move stringToMove(const string &moveStr, Board &b, bool &reversible) {
-    int startSq = 8 * (moveStr.at(1) - '1') + (moveStr.at(0) - 'a');
-    int endSq = 8 * (moveStr.at(3) - '1') + (moveStr.at(2) - 'a');
-
-    int color = b.getPlayerToMove();
-    bool isCapture = (bool)(indexToBit(endSq) & b.getAllPieces(color ^ 1));
-    bool isPawnMove = (bool)(indexToBit(startSq) & b.getPieces(color, PAWNS));
-    bool isKingMove = (bool)(indexToBit(startSq) & b.getPieces(color, KINGS));
-
-    bool isEP = (isPawnMove && !isCapture && ((endSq - startSq) & 1));
-    bool isDoublePawn = (isPawnMove && abs(endSq - startSq) == 16);
-    bool isCastle = (isKingMove && abs(endSq - startSq) == 2);
-    string promotionString = " nbrq";
-    int promotion = (moveStr.length() == 5)
-        ? promotionString.find(moveStr.at(4)) : 0;
-
-    Move m = encodeMove(startSq, endSq);
-    m = setCapture(m, isCapture);
-    m = setCastle(m, isCastle);
-    if (isEP)
-        m = setFlags(m, MOVE_EP);
-    else if (promotion) {
-        m = setFlags(m, MOVE_PROMO_N + promotion - 1);
-    }
-    else if (isDoublePawn)
-        m = setFlags(m, MOVE_DOUBLE_PAWN);
-
-    reversible = !(isCapture || isPawnMove || isCastle);
-    return m;
-}
-
-Board fenToBoard(string s) {
-    std::vector<string> components = split(s, ' ');
-    std::vector<string> rows = split(components.at(0), '/');
-    int mailbox[64];
-    int sqCounter = -1;
-    string pieceString = "PNBRQKpnbrqk";
-
-    // iterate through rows backwards (because mailbox goes a1 -> h8), converting into mailbox format
-    for (int elem = 7; elem >= 0; elem--) {
-        string rowAtElem = rows.at(elem);
 
-        for (unsigned col = 0; col < rowAtElem.length(); col++) {
-            char sq = rowAtElem.at(col);
-            do mailbox[++sqCounter] = pieceString.find(sq--);
-            while ('0' < sq && sq < '8');
-        }
-    }
-
-    int playerToMove = (components.at(1) == "w") ? WHITE : BLACK;
-    bool whiteCanKCastle = (components.at(2).find("K") != string::npos);
-    bool whiteCanQCastle = (components.at(2).find("Q") != string::npos);
-    bool blackCanKCastle = (components.at(2).find("k") != string::npos);
-    bool blackCanQCastle = (components.at(2).find("q") != string::npos);
-    int epCaptureFile = (components.at(3) == "-") ? NO_EP_POSSIBLE
-        : components.at(3).at(0) - 'a';
-    int fiftyMoveCounter = (components.size() == 6) ? std::stoi(components.at(4)) : 0;
-    int moveNumber = (components.size() == 6) ? std::stoi(components.at(5)) : 1;
-    return Board(mailbox, whiteCanKCastle, blackCanKCastle, whiteCanQCastle,
-            blackCanQCastle, epCaptureFile, fiftyMoveCounter, moveNumber,
-            playerToMove);
-}
-
-string boardToFEN(Board &board) {
-    int *mailbox = board.getMailbox();
-    string pieceString = "PNBRQKpnbrqk";
-    string fenString;
-    int emptyCt = 0;
-
-    for (int r = 7; r >= 0; r--) {
-        for (int f = 0; f < 8; f++) {
-            int sq = 8*r + f;
-            if (mailbox[sq] == -1)
-                emptyCt++;
-            else {
-                if (emptyCt) {
-                    fenString += std::to_string(emptyCt);
-                    emptyCt = 0;
-                }
-                fenString += pieceString[mailbox[sq]];
-            }
-        }
-
-        if (emptyCt) {
-            fenString += std::to_string(emptyCt);
-            emptyCt = 0;
-        }
-        if (r != 0)
-            fenString += '/';
-    }
-
-    fenString += ' ';
-    fenString += (board.getPlayerToMove() == WHITE) ? 'w' : 'b';
-    fenString += ' ';
-    bool hasCastles = false;
-    if (board.getWhiteCanKCastle()) { hasCastles = true; fenString += 'K'; }
-    if (board.getWhiteCanQCastle()) { hasCastles = true; fenString += 'Q'; }
-    if (board.getBlackCanKCastle()) { hasCastles = true; fenString += 'k'; }
-    if (board.getBlackCanQCastle()) { hasCastles = true; fenString += 'q'; }
-    if (!hasCastles) fenString += '-';
-    fenString += ' ';
-
-    uint16_t epCaptureFile = board.getEPCaptureFile();
-    if (epCaptureFile == NO_EP_POSSIBLE)
-        fenString += '-';
-    else {
-        fenString += 'a' + epCaptureFile;
-        fenString += (board.getPlayerToMove() == WHITE) ? '6' : '3';
-    }
-
-    fenString += ' ';
-    fenString += std::to_string(board.getFiftyMoveCounter());
-    fenString += ' ';
-    fenString += std::to_string(board.getMoveNumber());
-
-    return fenString;
+    bool appliedAll = playMoves(moveList, board, twoFoldPositions);
+    twoFoldPositions->setRootEnd();
+    // After an illegal or malformed move the board no longer matches the
+    // command, so the next one has to be parsed from scratch
+    if (appliedAll)
+        lastPositionInput = input;
+    else
+        lastPositionInput.clear();
 }
 
 string boardToString(Board &board) {
-    int *mailbox = board.getMailbox();
+    int mailbox[64];
+    board.getMailbox(mailbox);
     string pieceString = " PNBRQKpnbrqk";
     string boardString;
     for (int i = 7; i >= 0; i--) {
@@ -525,7 +679,6 @@ string boardToString(Board &board) {
         boardString += "|\n";
     }
     boardString += "  abcdefgh\n";
-    delete[] mailbox;
     return boardString;
 }
 
@@ -555,97 +708,436 @@ void stringToLowerCase(std::string &s) {
         for (std::size_t i = 0; i < j; i++)
             s[i] = tolower(s[i]);
     }
+    else if (equalsIgnoreCase(s.substr(0, 5), "bench")) {
+        // Keep the case of the word after "file", which is a path
+        bool isPath = false;
+        std::size_t start = 0;
+        while (start < s.size()) {
+            std::size_t end = s.find(' ', start);
+            if (end == std::string::npos)
+                end = s.size();
+            if (!isPath) {
+                for (std::size_t i = start; i < end; i++)
+                    s[i] = tolower(s[i]);
+            }
+            isPath = (s.compare(start, end - start, "file") == 0);
+            start = end + 1;
+        }
+    }
     else {
         for (std::size_t i = 0; i < s.size(); i++)
             s[i] = tolower(s[i]);
     }
 }
 
+// Maps the loaded Syzygy tables ahead of their first probes if warm-up is on
+void prefetchTablebases() {
+    if (!syzygyPrefetch || TBlargest == 0)
+        return;
+    int lockFailures = prefetch_tablebases(syzygyLockPieces);
+    if (lockFailures > 0)
+        OutputLine() << "info string Could not lock " << lockFailures << " syzygy tables in memory.";
+    printTBResidency();
+}
+
+void printTBResidency() {
+    TBResidency residency = get_tb_residency();
+    OutputLine() << "info string syzygy tables " << residency.tables << " mapped " << residency.mapped
+                 << " (" << (residency.mappedBytes >> 20) << " MB) resident " << (residency.residentBytes >> 20)
+                 << " MB locked " << (residency.lockedBytes >> 20) << " MB";
+}
+
+// Hands the book to the search once it is ready to use
+void updateBook() {
+    uciSearch.setBook(book.isOpen() ? &book : nullptr, bookDepth, bookBestMove);
+}
+
+// Only complete, reproducible searches are cached: fixed depth, nodes or
+// movetime, with the whole root and a single PV
+bool isCacheableSearch(const string &input) {
+    return resultCache.isOpen()
+        && (timeParams.searchMode == NODES || timeParams.searchMode == MOVETIME
+         || (timeParams.searchMode == DEPTH && input.find("infinite") == string::npos))
+        && input.find("ponder") == string::npos
+        && input.find("searchmoves") == string::npos
+        && uciSearch.getMultiPV() == 1;
+}
+
+// Answers a go command from the result cache if the position was searched
+// with the same limit before. Returns true if a bestmove was sent.
+bool playCachedResult(const Board &board) {
+    SearchResult result;
+    if (!resultCache.probe(board.getZobristKey(), timeParams, result))
+        return false;
+
+    // Guard against key collisions
+    MoveList legalMoves = board.getAllLegalMoves(board.getPlayerToMove());
+    bool isLegal = false;
+    for (unsigned int i = 0; i < legalMoves.size(); i++)
+        isLegal |= (legalMoves.get(i) == result.bestMove);
+    if (!isLegal)
+        return false;
+
+    OutputLine() << "info depth " << result.depth << " score " << scoreToString(result.score)
+                 << " nodes 0 pv " << retrievePV(&result.pv);
+    OutputLine() << "info string result cache hit";
+    if (result.ponder != NULL_MOVE)
+        OutputLine() << "bestmove " << moveToString(result.bestMove) << " ponder " << moveToString(result.ponder);
+    else
+        OutputLine() << "bestmove " << moveToString(result.bestMove);
+
+    uciSearch.isStop = true;
+    uciSearch.stopSignal = true;
+    return true;
+}
+
+// Runs a search, together with the cluster's helper processes if requested,
+// and saves its result if it was allowed to finish
+void runSearch(Board *board, TimeManagement limit, bool cacheable, bool useCluster) {
+    uint64_t key = board->getZobristKey();
+    if (!useCluster) {
+        uciSearch.getBestMoveThreader(board, &limit, &movesToSearch);
+        if (cacheable && !searchInterrupted)
+            resultCache.store(key, limit, uciSearch.getResult());
+        return;
+    }
+
+    // The best move is only known once the helpers' results are in, so our
+    // own search reports through the iteration callback
+    SearchResult combined;
+    uciSearch.setSilent(true);
+    uciSearch.setIterationCallback([](const SearchResult &progress) {
+        OutputLine() << "info depth " << progress.depth << " score " << scoreToString(progress.score)
+                     << " time " << progress.time << " nodes " << progress.nodes
+                     << " nps " << 1000 * progress.nodes / std::max(progress.time, (uint64_t) 1)
+                     << " pv " << retrievePV(&progress.pv);
+    });
+    cluster.search(uciSearch, board, &limit, combined);
+    uciSearch.setIterationCallback(nullptr);
+    uciSearch.setSilent(false);
+
+    OutputLine() << "info string cluster nodes " << combined.nodes << " depth " << combined.depth
+                 << " score " << scoreToString(combined.score);
+    if (combined.ponder != NULL_MOVE)
+        OutputLine() << "bestmove " << moveToString(combined.bestMove) << " ponder " << moveToString(combined.ponder);
+    else
+        OutputLine() << "bestmove " << moveToString(combined.bestMove);
+    if (cacheable && !searchInterrupted)
+        resultCache.store(key, limit, combined);
+}
+
 void clearAll(Board &board) {
-    clearTables();
+    uciSearch.clearTables();
     board = fenToBoard(STARTPOS);
+    lastPositionInput.clear();
+}
+
+// Parses the arguments following "bench". A leading number is taken as the
+// depth. Returns false after printing a usage message if they do not make
+// sense.
+bool parseBenchOptions(const std::vector<string> &args, BenchOptions &options) {
+    uint64_t value = 0;
+    unsigned int i = 0;
+    if (!args.empty() && parseNumber(args[0].c_str(), value)) {
+        // A depth of 0 keeps the default
+        if (value)
+            options.depth = (int) std::min(value, (uint64_t) MAX_DEPTH);
+        i++;
+    }
+
+    for (; i < args.size(); i++) {
+        if (args[i] == "json") {
+            options.jsonOutput = true;
+            continue;
+        }
+        if (i + 1 >= args.size()) {
+            cerr << "Usage: bench [depth] [file <positions>] [depth <n>] [threads <n>] "
+                 << "[hash <MB>] [runs <n>] [warmup <n>] [json]" << endl;
+            return false;
+        }
+        if (args[i] == "file") {
+            options.positionsFile = args[++i];
+            continue;
+        }
+
+        const string &name = args[i];
+        if (!parseNumber(args[++i].c_str(), value)) {
+            cerr << "Invalid bench option: " << name << endl;
+            return false;
+        }
+        int intValue = (int) std::min(value, (uint64_t) 0x7FFFFFFF);
+        if (name == "depth")
+            options.depth = std::max(1, std::min(MAX_DEPTH, intValue));
+        else if (name == "threads")
+            options.threads = std::max(MIN_THREADS, std::min(MAX_THREADS, intValue));
+        else if (name == "hash")
+            options.hashMB = std::max(MIN_HASH_SIZE, std::min(MAX_HASH_SIZE, value));
+        else if (name == "runs")
+            options.runs = std::max(1, intValue);
+        else if (name == "warmup")
+            options.warmupRuns = intValue;
+        else {
+            cerr << "Invalid bench option: " << name << endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 /*
- * Performs a PERFT (performance test). Useful for testing/debugging
- * PERFT n counts the number of possible positions after n moves by either side,
- * ex. PERFT 4 = # of positions after 2 moves from each side
- *
- * 7/8/15: PERFT 5, 1.46 s (i5-2450m)
- * 7/11/15: PERFT 5, 1.22 s (i5-2450m)
- * 7/13/15: PERFT 5, 1.08 s (i5-2450m)
- * 7/14/15: PERFT 5, 0.86 s (i5-2450m)
- * 7/17/15: PERFT 5, 0.32 s (i5-2450m)
- * 8/7/15: PERFT 5, 0.25 s, PERFT 6, 6.17 s (i5-5200u)
- * 8/8/15: PERFT 6, 5.90 s (i5-5200u)
- * 8/11/15: PERFT 6, 5.20 s (i5-5200u)
+ * Searches the bench positions, or those of a FEN/EPD or packed file, the
+ * given number of times and reports the spread of the speed across runs. The
+ * 95% confidence interval of the mean NPS uses Student's t distribution, so
+ * that a handful of runs is enough to tell whether two builds differ.
+ * The signature hashes the node count of every position searched, and
+ * changes with almost any functional change even when the total stays the
+ * same. With more than one thread node counts are not reproducible, and
+ * neither is the signature.
  */
-uint64_t perft(Board &b, int color, int depth, uint64_t &captures) {
-    if (depth == 0)
-        return 1;
-
-    uint64_t nodes = 0;
+void runBenchmark(const BenchOptions &options) {
+    std::vector<Board> boards;
+    uint64_t errors = 0;
+    if (options.positionsFile.empty()) {
+        for (unsigned int i = 0; i < benchPositions.size(); i++)
+            boards.push_back(fenToBoard(benchPositions[i]));
+    }
+    else if (!readPositionFile(options.positionsFile, boards, errors))
+        return;
+    if (boards.empty()) {
+        cerr << "No positions to search" << endl;
+        return;
+    }
 
-    MoveList pl;
-    b.getAllPseudoLegalMoves(pl, color);
-    for (unsigned int i = 0; i < pl.size(); i++) {
-        Board copy = b.staticCopy();
-        if (!copy.doPseudoLegalMove(pl.get(i), color))
+    Search search;
+    search.setSilent(true);
+    search.setNumThreads(options.threads);
+    search.setHashSize(options.hashMB);
+
+    TimeManagement limit;
+    limit.searchMode = DEPTH;
+    limit.allotment = options.depth;
+    limit.maxAllotment = 0;
+    MoveList rootMoves;
+
+    // Time in microseconds and node count of each run
+    std::vector<uint64_t> times, nodes;
+    uint64_t signature = 0;
+    bool stableNodes = true;
+
+    for (int run = 0; run < options.warmupRuns + options.runs; run++) {
+        uint64_t runNodes = 0;
+        // FNV-1a over the node counts of the positions
+        uint64_t runSignature = 0xCBF29CE484222325ULL;
+        // Only the searches are timed, since clearing a large table can take
+        // longer than searching
+        uint64_t time = 0;
+
+        for (unsigned int i = 0; i < boards.size(); i++) {
+            search.clearTables();
+            auto startTime = ChessClock::now();
+            search.isStop = false;
+            search.stopSignal = false;
+            search.getBestMoveThreader(&boards[i], &limit, &rootMoves);
+            search.isStop = true;
+            search.stopSignal = true;
+            time += (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                ChessClock::now() - startTime).count();
+
+            uint64_t positionNodes = search.getNodes();
+            runNodes += positionNodes;
+            runSignature = (runSignature ^ positionNodes) * 0x100000001B3ULL;
+        }
+        time = std::max((uint64_t) 1, time);
+        if (run < options.warmupRuns)
             continue;
 
-        if (isCapture(pl.get(i)))
-            captures++;
+        if (!nodes.empty() && (runNodes != nodes[0] || runSignature != signature))
+            stableNodes = false;
+        signature = runSignature;
+        times.push_back(time);
+        nodes.push_back(runNodes);
+        if (options.runs > 1 && !options.jsonOutput) {
+            cerr << "Run " << std::left << std::setw(6) << times.size() << std::right
+                 << ": " << time / 1000 << " ms, " << runNodes << " nodes, "
+                 << 1000000 * runNodes / time << " nps" << endl;
+        }
+    }
 
-        nodes += perft(copy, color^1, depth-1, captures);
+    // Mean and sample standard deviation of the speed
+    int n = (int) times.size();
+    std::vector<double> nps(n);
+    double mean = 0, variance = 0;
+    for (int i = 0; i < n; i++) {
+        nps[i] = 1000000.0 * nodes[i] / times[i];
+        mean += nps[i] / n;
+    }
+    for (int i = 0; i < n; i++)
+        variance += (nps[i] - mean) * (nps[i] - mean) / std::max(1, n - 1);
+    double stdev = std::sqrt(variance);
+    double margin = getStudentT95(n - 1) * stdev / std::sqrt((double) n);
+    uint64_t totalTime = 0;
+    for (int i = 0; i < n; i++)
+        totalTime += times[i];
+
+    if (options.jsonOutput) {
+        OutputLine out;
+        out << "{\"positions\":" << boards.size() << ",\"depth\":" << options.depth
+            << ",\"threads\":" << options.threads << ",\"hash\":" << options.hashMB
+            << ",\"runs\":" << n << ",\"nodes\":" << nodes[0]
+            << ",\"signature\":\"" << std::hex << std::setfill('0') << std::setw(16) << signature
+            << std::dec << std::setfill(' ') << "\",\"stable\":" << (stableNodes ? "true" : "false")
+            << ",\"time\":" << totalTime / 1000 << std::fixed << std::setprecision(0)
+            << ",\"nps\":{\"mean\":" << mean << ",\"stdev\":" << stdev
+            << ",\"ci95\":[" << mean - margin << "," << mean + margin << "]},\"samples\":[";
+        for (int i = 0; i < n; i++)
+            out << (i ? "," : "") << "{\"time\":" << times[i] << ",\"nodes\":" << nodes[i] << "}";
+        out << "]}";
+        return;
     }
 
-    return nodes;
+    std::ostringstream signatureString, spread;
+    signatureString << std::hex << std::setfill('0') << std::setw(16) << signature;
+
+    cerr << "Positions : " << boards.size() << endl;
+    if (errors)
+        cerr << "Errors    : " << errors << endl;
+    cerr << "Time      : " << totalTime / 1000 << " ms" << endl;
+    cerr << "Nodes     : " << nodes[0] << (stableNodes ? "" : " (varies across runs)") << endl;
+    cerr << "Signature : " << signatureString.str() << endl;
+    cerr << "NPS       : " << (uint64_t) mean << endl;
+    if (n > 1) {
+        spread << std::fixed << std::setprecision(2);
+        spread << "NPS stdev : " << (uint64_t) stdev << " (" << 100 * stdev / mean << "%)\n";
+        spread << "NPS 95% CI: " << (uint64_t) std::max(0.0, mean - margin) << " - "
+               << (uint64_t) (mean + margin) << " (+/- " << 100 * margin / mean << "%)\n";
+        cerr << spread.str();
+    }
 }
 
-void runBenchmark(Board &b, int depth) {
-    const std::vector<string> benchPositions = {
-        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
-        "r2q4/pp1k1pp1/2p1r1np/5p2/2N5/1P5Q/5PPP/3RR1K1 b - -",
-        "5k2/1qr2pp1/2Np1n1r/QB2p3/2R4p/3PPRPb/PP2P2P/6K1 w - -",
-        "r2r2k1/2p2pp1/p1n4p/1qbnp3/2Q5/1PPP1RPP/3NN2K/R1B5 b - -",
-        "8/3k4/p6Q/pq6/3p4/1P6/P3p1P1/6K1 w - -",
-        "8/8/k7/2B5/P1K5/8/8/1r6 w - -",
-        "8/8/8/p1k4p/P2R3P/2P5/1K6/5q2 w - -",
-        "rnbq1k1r/ppp1ppb1/5np1/1B1pN2p/P2P1P2/2N1P3/1PP3PP/R1BQK2R w KQ -",
-        "4r3/6pp/2p1p1k1/4Q2n/1r2Pp2/8/6PP/2R3K1 w - -",
-        "8/3k2p1/p2P4/P5p1/8/1P1R1P2/5r2/3K4 w - -",
-        "r5k1/1bqnbp1p/r3p1p1/pp1pP3/2pP1P2/P1P2N1P/1P2NBP1/R2Q1RK1 b - -",
-        "r1bqk2r/1ppnbppp/p1np4/4p1P1/4PP2/3P1N1P/PPP5/RNBQKBR1 b Qkq -",
-        "5nk1/6pp/8/pNpp4/P7/1P1Pp3/6PP/6K1 w - -",
-        "2r2rk1/1p2npp1/1q1b1nbp/p2p4/P2N3P/BPN1P3/4BPP1/2RQ1RK1 w - -",
-        "8/2b3p1/4knNp/2p4P/1pPp1P2/1P1P1BPK/8/8 w - -"
+// The two-sided 95% critical value of Student's t distribution
+double getStudentT95(int degrees) {
+    static const double T95[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
     };
+    if (degrees < 1)
+        return 0;
+    return degrees <= 30 ? T95[degrees - 1] : 1.96;
+}
+
+// Measures the throughput of the FEN parser and writer, and of unpacking
+// packed positions, on the bench positions
+void runFENBenchmark(int iterations) {
+    std::vector<StringView> fens;
+    std::vector<Board> boards(benchPositions.size());
+    for (unsigned int i = 0; i < benchPositions.size(); i++) {
+        fens.push_back(StringView(benchPositions.at(i)));
+        parseFEN(fens.back(), boards.at(i));
+    }
+    uint64_t total = (uint64_t) iterations * benchPositions.size();
+    // Keeps the work from being optimized away
+    uint64_t checksum = 0;
 
     auto startTime = ChessClock::now();
-    uint64_t totalNodes = 0;
-    movesToSearch.clear();
-    timeParams.searchMode = DEPTH;
-    // Set a default when the given depth is 0.
-    timeParams.allotment = depth ? depth : 13;
+    Board b;
+    for (int i = 0; i < iterations; i++) {
+        for (unsigned int j = 0; j < fens.size(); j++) {
+            parseFEN(fens[j], b);
+            checksum ^= b.getZobristKey();
+        }
+    }
+    uint64_t parseTime = getTimeElapsed(startTime);
 
-    for (unsigned int i = 0; i < benchPositions.size(); i++) {
-        clearAll(b);
-        b = fenToBoard(benchPositions.at(i));
+    startTime = ChessClock::now();
+    char buffer[MAX_FEN_LENGTH];
+    for (int i = 0; i < iterations; i++) {
+        for (unsigned int j = 0; j < boards.size(); j++)
+            checksum += writeFEN(boards[j], buffer);
+    }
+    uint64_t writeTime = getTimeElapsed(startTime);
+
+    std::vector<PackedPosition> packed;
+    for (unsigned int j = 0; j < boards.size(); j++)
+        packed.push_back(packPosition(boards[j]));
+    startTime = ChessClock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (unsigned int j = 0; j < packed.size(); j++)
+            checksum ^= unpackPosition(packed[j]).getZobristKey();
+    }
+    uint64_t unpackTime = getTimeElapsed(startTime);
 
-        isStop = false;
-        stopSignal = false;
-        getBestMoveThreader(&b, &timeParams, &movesToSearch);
-        isStop = true;
-        stopSignal = true;
+    cerr << "FENs        : " << total << endl;
+    cerr << "Parse FENs/s: " << 1000 * total / parseTime << endl;
+    cerr << "Write FENs/s: " << 1000 * total / writeTime << endl;
+    cerr << "Unpacks/s   : " << 1000 * total / std::max((uint64_t) 1, unpackTime) << endl;
+    cerr << "Checksum    : " << checksum << endl;
+}
 
-        totalNodes += getNodes();
+/*
+ * Probes the WDL tables of a set of endgames from several threads at once.
+ * The tables are reloaded before each cold pass, so that every table is
+ * mapped and initialized by whichever thread reaches it first. With N
+ * threads starting at different positions, a cold pass should take about
+ * 1/N of the single-threaded time unless threads wait on each other.
+ */
+void runTBBenchmark(const string &path, int threads) {
+    threads = std::max(MIN_THREADS, std::min(MAX_THREADS, threads));
+    std::vector<char> tbPath(path.begin(), path.end());
+    tbPath.push_back('\0');
+    init_tablebases(tbPath.data());
+    if (TBlargest == 0) {
+        cerr << "No tablebases found in " << path << endl;
+        return;
     }
 
-    uint64_t time = getTimeElapsed(startTime);
+    std::vector<Board> boards;
+    for (unsigned int i = 0; i < tbBenchPositions.size(); i++) {
+        Board b = fenToBoard(tbBenchPositions[i]);
+        if (count(b.getAllPieces(WHITE) | b.getAllPieces(BLACK)) <= TBlargest)
+            boards.push_back(b);
+    }
 
-    clearAll(b);
+    // Returns the wall time in microseconds for every thread to probe every
+    // position the given number of times
+    std::atomic<uint64_t> hits(0);
+    auto probeAll = [&](int numThreads, int passes) {
+        std::atomic<bool> start(false);
+        std::vector<std::thread> probers;
+        for (int t = 0; t < numThreads; t++) {
+            probers.push_back(std::thread([&, t]() {
+                while (!start)
+                    std::this_thread::yield();
+                unsigned int offset = t * boards.size() / numThreads;
+                for (int pass = 0; pass < passes; pass++) {
+                    for (unsigned int j = 0; j < boards.size(); j++) {
+                        int success = 0;
+                        probe_wdl(boards[(j + offset) % boards.size()], &success);
+                        hits += success;
+                    }
+                }
+            }));
+        }
+        auto startTime = ChessClock::now();
+        start = true;
+        for (unsigned int t = 0; t < probers.size(); t++)
+            probers[t].join();
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+            ChessClock::now() - startTime).count();
+    };
 
-    cerr << "Time  : " << time << " ms" << endl;
-    cerr << "Nodes : " << totalNodes << endl;
-    cerr << "NPS   : " << 1000 * totalNodes / time << endl;
+    init_tablebases(tbPath.data());
+    uint64_t coldSingle = probeAll(1, 1);
+    init_tablebases(tbPath.data());
+    uint64_t coldThreaded = probeAll(threads, 1);
+    hits = 0;
+    uint64_t warm = std::max((uint64_t) 1, probeAll(threads, TB_BENCH_PASSES));
+    uint64_t probes = (uint64_t) threads * TB_BENCH_PASSES * boards.size();
+
+    cerr << "Tables      : " << boards.size() << endl;
+    cerr << "Threads     : " << threads << endl;
+    cerr << "Cold 1 (us) : " << coldSingle << endl;
+    cerr << "Cold N (us) : " << coldThreaded << endl;
+    cerr << "Probes/s    : " << 1000000 * probes / warm << endl;
+    cerr << "Hits        : " << hits << "/" << probes << endl;
 }
@@ -37,8 +37,20 @@ constexpr int MAX_BUFFER_TIME = 5000;
 constexpr int DEFAULT_EVAL_SCALE = 100;
 constexpr int MIN_EVAL_SCALE = 0;
 constexpr int MAX_EVAL_SCALE = 500;
-
-Board fenToBoard(std::string s);
-std::string boardToFEN(Board &board);
+constexpr uint64_t DEFAULT_RESULT_CACHE_SIZE = 16;
+constexpr uint64_t MIN_RESULT_CACHE_SIZE = 1;
+constexpr uint64_t MAX_RESULT_CACHE_SIZE = 64 * 1024;
+// Book moves are played up to this move number
+constexpr int DEFAULT_BOOK_DEPTH = 20;
+constexpr int MIN_BOOK_DEPTH = 1;
+constexpr int MAX_BOOK_DEPTH = 255;
+// Syzygy WDL tables of at most this many pieces are locked in memory
+constexpr int DEFAULT_SYZYGY_LOCK_PIECES = 0;
+constexpr int MIN_SYZYGY_LOCK_PIECES = 0;
+constexpr int MAX_SYZYGY_LOCK_PIECES = 5;
+// Depth of each bench search unless another is given
+constexpr int DEFAULT_BENCH_DEPTH = 13;
+// Warm passes over the endgames of tbbench
+constexpr int TB_BENCH_PASSES = 2000;
 
 #endif